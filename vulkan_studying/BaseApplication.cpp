@@ -1,4 +1,8 @@
 #include "BaseApplication.h"
+#include "FluidFrameRing.h"
+#include "FluidRecorder.h"
+#include "FluidSolver.h"
+#include "FluidStatsLog.h"
 
 #undef max
 #undef min
@@ -16,8 +20,11 @@ BaseApplication::~BaseApplication()
 		delete camera;
 	}
 
-	delete m_window;
-	SDL_Quit();
+	if (m_window != nullptr)
+	{
+		delete m_window;
+		SDL_Quit();
+	}
 }
 
 void BaseApplication::run()
@@ -27,6 +34,22 @@ void BaseApplication::run()
 	loop();
 }
 
+void BaseApplication::runHeadless(const HeadlessSettings& settings)
+{
+	m_headless = true;
+	initComputeVulkan();
+	simulate(settings);
+}
+
+void BaseApplication::runViewer(const std::string& frameRingName)
+{
+	m_frameRingName = frameRingName;
+	m_frameRing.reset(new FluidFrameRing(frameRingName));
+	m_viewedFluid.reset(new Fluid());
+	m_viewedFluid->attachSubscriber(m_frameRing.get());
+	run();
+}
+
 void BaseApplication::createWindow()
 {
 	m_window = new Window();
@@ -111,12 +134,63 @@ void BaseApplication::initVulkan()
 
 	createVertexBuffer();
 	createIndexBuffer();
-	createUniformBuffer();
+	createFrameAllocator();
 	createDescriptorPool();
 	createDescriptorSet();
 
-	createCommandBuffers();
-	createSemaphores();
+	createCommandPools();
+	createFrames();
+}
+
+void BaseApplication::initComputeVulkan()
+{
+	if (enableValidationLayers && !checkValidationLayerSupport()) {
+		throw std::runtime_error("validation layers requested, but not available");
+	}
+
+	checkExtensions();
+	createVulkanInstance();
+	setupDebugCallback();
+	setupDevice();
+}
+
+void BaseApplication::simulate(const HeadlessSettings& settings)
+{
+	Fluid fluid(settings.particle, settings.params);
+	// Nothing else runs in headless mode, so the solver may take every core
+	fluid.getSolver().setThreadsCount(0);
+
+	FluidStatsLog statsLog(settings.statsFilename);
+	fluid.attachStatsLog(&statsLog);
+
+	std::unique_ptr<FluidRecorder> recorder;
+	if (!settings.recordingFilename.empty())
+	{
+		// Positions to a hundredth of the particle radius, well under what a renderer would show
+		recorder.reset(new FluidRecorder(settings.recordingFilename, settings.params.particleRadius * 0.01f));
+		fluid.attachRecorder(recorder.get());
+	}
+
+	std::unique_ptr<FluidFrameRing> frameRing;
+	if (!settings.frameRingName.empty())
+	{
+		frameRing.reset(new FluidFrameRing(settings.frameRingName, settings.params.particlesCount));
+		fluid.attachPublisher(frameRing.get());
+	}
+
+	// Publishing runs with 0 steps go on until the process is stopped
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t step = 0; step < settings.stepsCount || (settings.stepsCount == 0 && frameRing); step++)
+	{
+		fluid.update();
+	}
+	if (recorder)
+	{
+		recorder->flush();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::cout << settings.stepsCount << " steps of " << settings.params.particlesCount << " particles in " << seconds << " s" << std::endl;
 }
 
 void BaseApplication::createVulkanInstance()
@@ -162,7 +236,7 @@ void BaseApplication::setupDebugCallback()
 	createInfo.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
 	createInfo.pfnCallback = debugCallback;
 
-	if (CreateDebugReportCallbackEXT(m_instance, &createInfo, nullptr, m_callback.data()) != VK_SUCCESS) {
+	if (CreateDebugReportCallbackEXT(m_instance, &createInfo, nullptr, m_callback.data(m_instance)) != VK_SUCCESS) {
 		throw std::runtime_error("failed to set up debug callback");
 	}
 }
@@ -181,7 +255,7 @@ void BaseApplication::createSurface()
 	auto CreateWin32SurfaceKHR = (PFN_vkCreateWin32SurfaceKHR)vkGetInstanceProcAddr(m_instance, "vkCreateWin32SurfaceKHR");
 
 	if (!CreateWin32SurfaceKHR || CreateWin32SurfaceKHR(m_instance, &win32SurfaceCreateInfoKhr,
-		nullptr, m_surface.data()) != VK_SUCCESS) {
+		nullptr, m_surface.data(m_instance)) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create window surface");
 	}
 #elif defined(__ANDROID__)
@@ -212,7 +286,18 @@ void BaseApplication::setupDevice()
 	std::vector<VkPhysicalDevice> physicalDevices(physicalDevicesCount);
 	vkEnumeratePhysicalDevices(m_instance, &physicalDevicesCount, physicalDevices.data());
 
-	m_device.init(physicalDevices);
+	if (m_headless)
+	{
+		m_device.init(m_instance, physicalDevices, false, VK_QUEUE_COMPUTE_BIT);
+	}
+	else
+	{
+		m_device.init(m_instance, physicalDevices);
+		// Asset streaming rides the DMA queue
+		m_uploads.init(m_device.getTransferQueue(), m_device.queueFamilyIndices.transferFamily);
+		m_uploads.addConsumer(m_device.getGraphicsQueue(), m_device.queueFamilyIndices.graphicsFamily);
+		m_defragmenter.init(m_device.getGraphicsQueue(), m_device.queueFamilyIndices.graphicsFamily, &m_deletionQueue);
+	}
 }
 
 /*void BaseApplication::selectPhysicalDevice()
@@ -383,7 +468,9 @@ void BaseApplication::createSwapchain()
 	if (vkCreateSwapchainKHR(m_device.getLogicalDevice(), &swapChainCreateInfo, nullptr, &newSwapchain) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create swap chain");
 	}
-	m_swapchain = newSwapchain;
+	// Images of the old swapchain may still be waiting to be presented
+	m_deletionQueue.retire(m_swapchain);
+	m_swapchain.reset(m_device.getLogicalDevice(), newSwapchain);
 
 
 	if(vkGetSwapchainImagesKHR(m_device.getLogicalDevice(), m_swapchain, &imageCount, nullptr) != VK_SUCCESS)
@@ -403,7 +490,7 @@ void BaseApplication::createSwapchain()
 void BaseApplication::createImageViews()
 {
 	///auto swapchainImages = m_swapchain.getSwapchainImages();
-	m_swapchainImageViews.resize(m_swapchainImages.size(), Cleaner<VkImageView>{m_device.getLogicalDevice(), vkDestroyImageView});
+	m_swapchainImageViews.resize(m_swapchainImages.size());
 	///auto imageFormat = m_swapchain.getSwapchainImageFormat();
 
 	for (uint32_t i = 0; i < m_swapchainImages.size(); i++) 
@@ -423,7 +510,7 @@ void BaseApplication::createImageViews()
 		createInfo.subresourceRange.baseArrayLayer = 0;
 		createInfo.subresourceRange.layerCount = 1;
 
-		if (vkCreateImageView(m_device.getLogicalDevice(), &createInfo, nullptr, m_swapchainImageViews[i].data()) != VK_SUCCESS) {
+		if (vkCreateImageView(m_device.getLogicalDevice(), &createInfo, nullptr, m_swapchainImageViews[i].data(m_device.getLogicalDevice())) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create image views");
 		}
 	}
@@ -467,7 +554,7 @@ void BaseApplication::createRenderPass()
 	renderPassInfo.dependencyCount = 1;
 	renderPassInfo.pDependencies = &subpassDependency;
 
-	if (vkCreateRenderPass(m_device.getLogicalDevice(), &renderPassInfo, nullptr, m_renderPass.data()) != VK_SUCCESS)
+	if (vkCreateRenderPass(m_device.getLogicalDevice(), &renderPassInfo, nullptr, m_renderPass.data(m_device.getLogicalDevice())) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create render pass");
 	}
@@ -477,7 +564,7 @@ void BaseApplication::createDescriptionSetLayout()
 {
 	VkDescriptorSetLayoutBinding layoutBinding = {};
 	layoutBinding.binding = 0;
-	layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	layoutBinding.descriptorCount = 1;
 	layoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	layoutBinding.pImmutableSamplers = nullptr;
@@ -487,7 +574,7 @@ void BaseApplication::createDescriptionSetLayout()
 	layoutInfo.bindingCount = 1;
 	layoutInfo.pBindings = &layoutBinding;
 
-	if (vkCreateDescriptorSetLayout(m_device.getLogicalDevice(), &layoutInfo, nullptr, m_descriptorSetLayout.data()) != VK_SUCCESS)
+	if (vkCreateDescriptorSetLayout(m_device.getLogicalDevice(), &layoutInfo, nullptr, m_descriptorSetLayout.data(m_device.getLogicalDevice())) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create descriptor set layout");
 	}
@@ -613,7 +700,7 @@ void BaseApplication::createGraphicsPipeline()
 	pipelineLayoutInfo.pushConstantRangeCount = 0;
 	pipelineLayoutInfo.pPushConstantRanges = 0;
 
-	if (vkCreatePipelineLayout(m_device.getLogicalDevice(), &pipelineLayoutInfo, nullptr, m_pipelineLayout.data()) != VK_SUCCESS)
+	if (vkCreatePipelineLayout(m_device.getLogicalDevice(), &pipelineLayoutInfo, nullptr, m_pipelineLayout.data(m_device.getLogicalDevice())) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create pipeline layout");
 	}
@@ -636,20 +723,20 @@ void BaseApplication::createGraphicsPipeline()
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 	pipelineInfo.basePipelineIndex = -1;
 
-	if (vkCreateGraphicsPipelines(m_device.getLogicalDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, m_graphicsPipeline.data()) != VK_SUCCESS)
+	if (vkCreateGraphicsPipelines(m_device.getLogicalDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, m_graphicsPipeline.data(m_device.getLogicalDevice())) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create graphics pipeline");
 	}
 }
 
-void BaseApplication::createShaderModule(const std::vector<char>& code, Cleaner<VkShaderModule>& shaderModule)
+void BaseApplication::createShaderModule(const std::vector<char>& code, DeviceCleaner<VkShaderModule, vkDestroyShaderModule>& shaderModule)
 {
 	VkShaderModuleCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 	createInfo.codeSize = code.size();
 	createInfo.pCode = (uint32_t*)code.data();
 
-	if (vkCreateShaderModule(m_device.getLogicalDevice(), &createInfo, nullptr, shaderModule.data()) != VK_SUCCESS)
+	if (vkCreateShaderModule(m_device.getLogicalDevice(), &createInfo, nullptr, shaderModule.data(m_device.getLogicalDevice())) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create shader module");
 	}
@@ -658,7 +745,7 @@ void BaseApplication::createShaderModule(const std::vector<char>& code, Cleaner<
 void BaseApplication::createFrameBuffers()
 {
 	///auto swapchainImageViews = m_swapchain.getSwapchainImageViews();
-	m_swapchainFramebuffers.resize(m_swapchainImageViews.size(), Cleaner<VkFramebuffer>{ m_device.getLogicalDevice(), vkDestroyFramebuffer });
+	m_swapchainFramebuffers.resize(m_swapchainImageViews.size());
 	
 	for (size_t i = 0; i < m_swapchainImageViews.size(); i++)
 	{
@@ -673,7 +760,7 @@ void BaseApplication::createFrameBuffers()
 		framebufferInfo.height = m_swapchainExtent.height;
 		framebufferInfo.layers = 1;
 
-		if (vkCreateFramebuffer(m_device.getLogicalDevice(), &framebufferInfo, nullptr, m_swapchainFramebuffers[i].data()) != VK_SUCCESS)
+		if (vkCreateFramebuffer(m_device.getLogicalDevice(), &framebufferInfo, nullptr, m_swapchainFramebuffers[i].data(m_device.getLogicalDevice())) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create framebuffer");
 		}
@@ -698,91 +785,72 @@ void BaseApplication::createVertexBuffer()
 {
 	VkDeviceSize bufferSize = sizeof(m_vertices[0]) * m_vertices.size();
 
-	Cleaner<VkBuffer> stagingBuffer{ m_device.getLogicalDevice(), vkDestroyBuffer };
-	Cleaner<VkDeviceMemory> stagingBufferMemory{ m_device.getLogicalDevice(), vkFreeMemory };
-
-	m_device.createBuffer(
-		bufferSize, 
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer,
-		stagingBufferMemory);
-
-	void* data;
-	if (vkMapMemory(m_device.getLogicalDevice(), stagingBufferMemory, 0, bufferSize, 0, &data) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to map memory");
-	}
-	memcpy(data, m_vertices.data(), (size_t) bufferSize);
-	vkUnmapMemory(m_device.getLogicalDevice(), stagingBufferMemory);
-
 	m_device.createBuffer(
 		bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		m_vertexBuffer,
-		m_vertexBufferMemory);
+		m_vertexBufferAllocation);
 
-	m_device.copyBuffer(stagingBuffer, m_vertexBuffer, bufferSize);
+	m_uploads.upload(m_vertexBuffer, 0, m_vertices.data(), bufferSize, m_device.queueFamilyIndices.graphicsFamily);
+	m_defragmenter.track(m_vertexBuffer, m_vertexBufferAllocation, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		[this](VkBuffer buffer) { onBufferMoved(buffer); });
 }
 
 void BaseApplication::createIndexBuffer()
 {
 	VkDeviceSize bufferSize = sizeof(m_indices[0]) * m_indices.size();
 
-	Cleaner<VkBuffer> stagingBuffer{ m_device.getLogicalDevice(), vkDestroyBuffer };
-	Cleaner<VkDeviceMemory> stagingBufferMemory{ m_device.getLogicalDevice(), vkFreeMemory };
-
 	m_device.createBuffer(
 		bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer,
-		stagingBufferMemory);
-
-	void* data;
-	if (vkMapMemory(m_device.getLogicalDevice(), stagingBufferMemory, 0, bufferSize, 0, &data) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to map memory");
-	}
-	memcpy(data, m_indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(m_device.getLogicalDevice(), stagingBufferMemory);
-
-	m_device.createBuffer(
-		bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		m_indexBuffer,
-		m_indexBufferMemory);
+		m_indexBufferAllocation);
 
-	m_device.copyBuffer(stagingBuffer, m_indexBuffer, bufferSize);
+	m_uploads.upload(m_indexBuffer, 0, m_indices.data(), bufferSize, m_device.queueFamilyIndices.graphicsFamily);
+	m_defragmenter.track(m_indexBuffer, m_indexBufferAllocation, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		[this](VkBuffer buffer) { onBufferMoved(buffer); });
+	// Vertices and indices go out in one submission
+	m_uploads.flush();
+
+	// The scene is the one quad for now
+	m_entityDraws.clear();
+	m_entityDraws.push_back({ static_cast<uint32_t>(m_indices.size()), 0, 0 });
 }
 
-void BaseApplication::createUniformBuffer()
+void BaseApplication::createFrameAllocator()
 {
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+	m_frameAllocator.init(getFramesInFlight(), VkDeviceSize(256) << 10, size_t(256) << 10);
+}
 
-	m_device.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_uniformStagingBuffer, m_uniformStagingBufferMemory);
-	m_device.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_uniformBuffer, m_uniformBufferMemory);
+void BaseApplication::updateUniformBuffer(uint32_t frame)
+{
+	static auto startTime = std::chrono::high_resolution_clock::now();
+	auto currentTime = std::chrono::high_resolution_clock::now();
+	auto time = std::chrono::duration_cast<std::chrono::microseconds>(currentTime - startTime).count() / 1000.0f;
 
 	UniformBufferObject ubo = {};
-	ubo.model = glm::mat4(1.0f);
+	ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 	ubo.view = glm::lookAt(glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.projection = glm::perspective(glm::radians(45.0f), m_swapchainExtent.width/static_cast<float>(m_swapchainExtent.height), 0.1f, 10.0f);
+	ubo.projection = glm::perspective(glm::radians(45.0f), m_swapchainExtent.width / static_cast<float>(m_swapchainExtent.height), 0.1f, 10.0f);
 	ubo.projection[1][1] *= -1;
 
-	void* data;
-	vkMapMemory(m_device.getLogicalDevice(), m_uniformStagingBufferMemory, 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(m_device.getLogicalDevice(), m_uniformStagingBufferMemory);
+	// The recorded dynamic offset is the frame's start, where its first allocation lands
+	FrameAllocation uniforms = m_frameAllocator.allocateUniform(sizeof(ubo));
+	assert(uniforms.offset == m_frameAllocator.getFrameOffset(frame));
+	memcpy(uniforms.mapped, &ubo, sizeof(ubo));
+}
 
-	m_device.copyBuffer(m_uniformStagingBuffer, m_uniformBuffer, sizeof(ubo));
+void BaseApplication::onBufferMoved(VkBuffer)
+{
+	// Draws are recorded every frame, the next one binds the new buffer and the old one is retired with this frame
 }
 
 void BaseApplication::createDescriptorPool()
 {
 	VkDescriptorPoolSize descriptorPoolSize = {};
-	descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	descriptorPoolSize.descriptorCount = 1;
 
 	VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
@@ -792,7 +860,7 @@ void BaseApplication::createDescriptorPool()
 	descriptorPoolInfo.maxSets = 1;
 	descriptorPoolInfo.flags = 0;
 
-	if (vkCreateDescriptorPool(m_device.getLogicalDevice(), &descriptorPoolInfo, nullptr, m_descriptorPool.data()) != VK_SUCCESS)
+	if (vkCreateDescriptorPool(m_device.getLogicalDevice(), &descriptorPoolInfo, nullptr, m_descriptorPool.data(m_device.getLogicalDevice())) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create descriptor pool");
 	}
@@ -812,8 +880,14 @@ void BaseApplication::createDescriptorSet()
 		throw std::runtime_error("failed to allocate descriptor set");
 	}
 
+	updateDescriptorSet();
+}
+
+void BaseApplication::updateDescriptorSet()
+{
+	// Every command buffer picks its frame's slot through the dynamic offset
 	VkDescriptorBufferInfo descriptorBufferInfo = {};
-	descriptorBufferInfo.buffer = m_uniformBuffer;
+	descriptorBufferInfo.buffer = m_frameAllocator.getBuffer();
 	descriptorBufferInfo.offset = 0;
 	descriptorBufferInfo.range = sizeof(UniformBufferObject);
 
@@ -822,7 +896,7 @@ void BaseApplication::createDescriptorSet()
 	writeDescriptorSet.dstSet = m_descriptorSet;
 	writeDescriptorSet.dstBinding = 0;
 	writeDescriptorSet.dstArrayElement = 0;
-	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	writeDescriptorSet.descriptorCount = 1;
 	writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
 	writeDescriptorSet.pImageInfo = nullptr;
@@ -831,7 +905,7 @@ void BaseApplication::createDescriptorSet()
 	vkUpdateDescriptorSets(m_device.getLogicalDevice(), 1, &writeDescriptorSet, 0, nullptr);
 }
 
-/*void BaseApplication::createBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags propertyFlags, Cleaner<VkBuffer>& buffer, Cleaner<VkDeviceMemory>& bufferMemory)
+/*void BaseApplication::createBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags propertyFlags, DeviceCleaner<VkBuffer, vkDestroyBuffer>& buffer, Cleaner<VkDeviceMemory>& bufferMemory)
 {
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -918,80 +992,162 @@ void BaseApplication::createDescriptorSet()
 	vkFreeCommandBuffers(m_device.getLogicalDevice(), m_commandPool, 1, &commandBuffer);
 }*/
 
-void BaseApplication::createCommandBuffers()
+void BaseApplication::createCommandPools()
 {
-	if (m_commandBuffers.size() > 0)
+	// Workers outlive swapchain recreation, headless runs never start them. A few unpinned threads are plenty to
+	// record the slices, and they leave the cores the simulation pinned its workers to alone
+	if (!m_recordWorkers)
 	{
-		vkFreeCommandBuffers(m_device.getLogicalDevice(), m_device.getCommandPool(), m_commandBuffers.size(), m_commandBuffers.data());
+		m_recordWorkers.reset(new WorkerPool(1 + std::min(hardwareThreads() - 1, static_cast<uint32_t>(maxRecordWorkers))));
 	}
 
-	m_commandBuffers.resize(m_swapchainFramebuffers.size());
-
-	VkCommandBufferAllocateInfo commandBufferAllocInfo = {};
-	commandBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	commandBufferAllocInfo.commandPool = m_device.getCommandPool();
-	commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	commandBufferAllocInfo.commandBufferCount = (uint32_t)m_commandBuffers.size();
+	// One slot per recording worker, the main thread is worker 0 and records the primary buffers in slot 0 as well
+	m_commandPools.init(m_device.queueFamilyIndices.graphicsFamily, getFramesInFlight(), m_recordWorkers->getThreadsCount());
+}
 
-	if (vkAllocateCommandBuffers(m_device.getLogicalDevice(), &commandBufferAllocInfo, m_commandBuffers.data()) != VK_SUCCESS)
+void BaseApplication::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t frame)
+{
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = nullptr;
+
+	vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = m_renderPass;
+	renderPassBeginInfo.framebuffer = m_swapchainFramebuffers[imageIndex];
+	renderPassBeginInfo.renderArea.offset = { 0, 0 };
+	renderPassBeginInfo.renderArea.extent = m_swapchainExtent;
+	VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 0.0f };
+	renderPassBeginInfo.clearValueCount = 1;
+	renderPassBeginInfo.pClearValues = &clearColor;
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	// Worker t records slice t into a secondary buffer from its own pool slot; workers past the last slice stay idle
+	size_t slicesCount = (m_entityDraws.size() + minDrawsPerThread - 1) / minDrawsPerThread;
+	slicesCount = std::max<size_t>(std::min<size_t>(slicesCount, m_recordWorkers->getThreadsCount()), 1);
+	VkCommandBuffer* secondaries = m_frameAllocator.allocateHost<VkCommandBuffer>(slicesCount);
+	auto recordSlice = [&](uint32_t slice)
 	{
-		throw std::runtime_error("failed to allocate command buffers");
+		size_t begin = m_entityDraws.size() * slice / slicesCount;
+		size_t end = m_entityDraws.size() * (slice + 1) / slicesCount;
+		secondaries[slice] = recordEntities(imageIndex, frame, slice, begin, end);
+	};
+	if (slicesCount == 1)
+	{
+		recordSlice(0);
 	}
-
-	for (size_t i = 0; i < m_commandBuffers.size(); i++)
+	else
 	{
-		VkCommandBufferBeginInfo commandBufferBeginInfo = {};
-		commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		commandBufferBeginInfo.pInheritanceInfo = nullptr;
-
-		vkBeginCommandBuffer(m_commandBuffers[i], &commandBufferBeginInfo);
+		m_recordWorkers->run([&](uint32_t thread)
+		{
+			if (thread < slicesCount)
+			{
+				recordSlice(thread);
+			}
+		});
+	}
+	vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(slicesCount), secondaries);
 
-		VkRenderPassBeginInfo renderPassBeginInfo = {};
-		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassBeginInfo.renderPass = m_renderPass;
-		renderPassBeginInfo.framebuffer = m_swapchainFramebuffers[i];
-		renderPassBeginInfo.renderArea.offset = { 0, 0 };
-		renderPassBeginInfo.renderArea.extent = m_swapchainExtent;
-		VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 0.0f };
-		renderPassBeginInfo.clearValueCount = 1;
-		renderPassBeginInfo.pClearValues = &clearColor;
+	vkCmdEndRenderPass(commandBuffer);
 
-		vkCmdBeginRenderPass(m_commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record command buffer");
+	}
+}
 
-		VkBuffer vertexBuffers[] = { m_vertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(m_commandBuffers[i], 0, 1, vertexBuffers, offsets);
-		vkCmdBindIndexBuffer(m_commandBuffers[i], m_indexBuffer, 0, VK_INDEX_TYPE_UINT16);
-		vkCmdBindDescriptorSets(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+VkCommandBuffer BaseApplication::recordEntities(uint32_t imageIndex, uint32_t frame, uint32_t thread, size_t begin, size_t end)
+{
+	VkCommandBuffer commandBuffer = m_commandPools.allocate(thread, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = m_renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = m_swapchainFramebuffers[imageIndex];
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+
+	// Bound state is not inherited from the primary buffer, every secondary one binds its own
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+	VkBuffer vertexBuffers[] = { m_vertexBuffer };
+	VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+	uint32_t uniformOffset = static_cast<uint32_t>(m_frameAllocator.getFrameOffset(frame));
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 1, &uniformOffset);
+
+	for (size_t i = begin; i < end; i++)
+	{
+		const EntityDraw& draw = m_entityDraws[i];
+		vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, draw.firstIndex, draw.vertexOffset, 0);
+	}
 
-		vkCmdDrawIndexed(m_commandBuffers[i], m_indices.size(), 1, 0, 0, 0);
-		vkCmdEndRenderPass(m_commandBuffers[i]);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record command buffer");
+	}
+	return commandBuffer;
+}
 
-		if (vkEndCommandBuffer(m_commandBuffers[i]) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to record command buffer");
-		}
+void BaseApplication::createFrames()
+{
+	// Only called with no frame in flight, the old objects are free to go back
+	for (const FrameInFlight& frame : m_frames)
+	{
+		m_device.getPools().releaseSemaphore(frame.imageAvailable);
+		m_device.getPools().releaseSemaphore(frame.renderFinished);
+		m_device.getPools().releaseFence(frame.fence);
 	}
 
+	// Recycled fences come back unsignalled, deletion frame 0 says there is nothing to wait for
+	m_frames.resize(getFramesInFlight());
+	for (FrameInFlight& frame : m_frames)
+	{
+		frame.imageAvailable = m_device.getPools().acquireSemaphore();
+		frame.renderFinished = m_device.getPools().acquireSemaphore();
+		frame.fence = m_device.getPools().acquireFence();
+		frame.deletionFrame = 0;
+	}
+	m_frameIndex = 0;
+	m_imageFrames.assign(m_swapchainImages.size(), static_cast<uint32_t>(noFrame));
 }
 
-void BaseApplication::createSemaphores()
+uint32_t BaseApplication::getFramesInFlight() const
 {
-	VkSemaphoreCreateInfo semaphoreInfo = {};
-	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	return std::min(static_cast<uint32_t>(m_swapchainImages.size()), static_cast<uint32_t>(maxFramesInFlight));
+}
 
-	if (vkCreateSemaphore(m_device.getLogicalDevice(), &semaphoreInfo, nullptr, m_imageAvailableSemaphore.data()) != VK_SUCCESS ||
-		vkCreateSemaphore(m_device.getLogicalDevice(), &semaphoreInfo, nullptr, m_renderFinishedSemaphore.data()) != VK_SUCCESS)
+void BaseApplication::retireSwapchainResources()
+{
+	for (auto& framebuffer : m_swapchainFramebuffers)
 	{
-		throw std::runtime_error("failed to create semaphores");
+		m_deletionQueue.retire(framebuffer);
 	}
+	m_swapchainFramebuffers.clear();
+	for (auto& imageView : m_swapchainImageViews)
+	{
+		m_deletionQueue.retire(imageView);
+	}
+	m_swapchainImageViews.clear();
+	m_deletionQueue.retire(m_graphicsPipeline);
+	m_deletionQueue.retire(m_pipelineLayout);
+	m_deletionQueue.retire(m_renderPass);
 }
 
 void BaseApplication::recreateSwapchain()
 {
-	vkDeviceWaitIdle(m_device.getLogicalDevice());
+	// Frames in flight keep the old objects, they are destroyed once those frames are done
+	retireSwapchainResources();
 
 	createSwapchain();
 	createImageViews();
@@ -1000,7 +1156,20 @@ void BaseApplication::recreateSwapchain()
 	createRenderPass();
 	createGraphicsPipeline();
 	createFrameBuffers();
-	createCommandBuffers();
+	// None of the new images has been drawn into yet
+	m_imageFrames.assign(m_swapchainImages.size(), static_cast<uint32_t>(noFrame));
+	// Frames in flight only follow the image count below maxFramesInFlight, rare enough to drain the device for
+	if (getFramesInFlight() != m_frames.size())
+	{
+		vkDeviceWaitIdle(m_device.getLogicalDevice());
+		if (getFramesInFlight() > m_frameAllocator.getFramesCount())
+		{
+			createFrameAllocator();
+			updateDescriptorSet();
+		}
+		createFrames();
+		createCommandPools();
+	}
 }
 
 void BaseApplication::loop()
@@ -1011,7 +1180,10 @@ void BaseApplication::loop()
 
 		while (SDL_PollEvent(&event))
 		{
-			if (event.type == SDL_KEYDOWN) m_running = false;
+			// M and J dump GPU memory usage as text or JSON, any other key quits
+			if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_m) m_device.printMemoryStats(std::cout);
+			else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_j) m_device.writeMemoryStatsJson(std::cout);
+			else if (event.type == SDL_KEYDOWN) m_running = false;
 			if (event.type == SDL_QUIT) m_running = false;
 
 			if (event.type == SDL_WINDOWEVENT_RESIZED)
@@ -1020,29 +1192,39 @@ void BaseApplication::loop()
 			}
 		}
 
-		
-		static auto startTime = std::chrono::high_resolution_clock::now();
-		auto currentTime = std::chrono::high_resolution_clock::now();
-		auto time = std::chrono::duration_cast<std::chrono::microseconds>(currentTime - startTime).count() / 1000.0f;
-
-		UniformBufferObject ubo = {};
-		ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		ubo.view = glm::lookAt(glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		ubo.projection = glm::perspective(glm::radians(45.0f), m_swapchainExtent.width / static_cast<float>(m_swapchainExtent.height), 0.1f, 10.0f);
-		ubo.projection[1][1] *= -1;
-
-		void* data;
-		vkMapMemory(m_device.getLogicalDevice(), m_uniformStagingBufferMemory, 0, sizeof(ubo), 0, &data);
-		memcpy(data, &ubo, sizeof(ubo));
-		vkUnmapMemory(m_device.getLogicalDevice(), m_uniformStagingBufferMemory);
-
-		m_device.copyBuffer(m_uniformStagingBuffer, m_uniformBuffer, sizeof(ubo));
-		
+		updateViewedFluid();
+		// A few megabytes of copies a frame keep long sessions from fragmenting memory without a visible hitch
+		m_defragmenter.step(VkDeviceSize(4) << 20);
 		draw();
 		//SDL_Delay(1);
 	}
 
 	vkDeviceWaitIdle(m_device.getLogicalDevice());
+	m_deletionQueue.flush();
+}
+
+void BaseApplication::updateViewedFluid()
+{
+	if (!m_viewedFluid)
+	{
+		return;
+	}
+
+	// A restarted simulation creates a new ring under the same name; until it shows up the last frame stays on screen
+	if (m_frameRing->isClosed())
+	{
+		try
+		{
+			std::unique_ptr<FluidFrameRing> frameRing(new FluidFrameRing(m_frameRingName));
+			m_viewedFluid->attachSubscriber(frameRing.get());
+			m_frameRing = std::move(frameRing);
+		}
+		catch (const std::runtime_error&)
+		{
+		}
+	}
+
+	m_viewedFluid->update();
 }
 
 void BaseApplication::draw()
@@ -1050,7 +1232,20 @@ void BaseApplication::draw()
 	uint32_t imageIndex;
 	VkResult result;
 
-	result = vkAcquireNextImageKHR(m_device.getLogicalDevice(), m_swapchain, std::numeric_limits<uint64_t>::max(), m_imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+	// The slot's previous frame must be done before its semaphores, uniform slot and command buffers are reused
+	FrameInFlight& frame = m_frames[m_frameIndex];
+	if (frame.deletionFrame != 0)
+	{
+		if (vkWaitForFences(m_device.getLogicalDevice(), 1, &frame.fence, VK_TRUE, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to wait for frame fence");
+		}
+		vkResetFences(m_device.getLogicalDevice(), 1, &frame.fence);
+		m_deletionQueue.collect(frame.deletionFrame);
+		frame.deletionFrame = 0;
+	}
+
+	result = vkAcquireNextImageKHR(m_device.getLogicalDevice(), m_swapchain, std::numeric_limits<uint64_t>::max(), frame.imageAvailable, VK_NULL_HANDLE, &imageIndex);
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR)
 	{
@@ -1062,26 +1257,44 @@ void BaseApplication::draw()
 		throw std::runtime_error("failed to acquire swap chain image");
 	}
 
+	// An image acquired out of order may still be drawn into by another slot's frame
+	uint32_t imageFrame = m_imageFrames[imageIndex];
+	if (imageFrame != noFrame && m_frames[imageFrame].deletionFrame != 0)
+	{
+		if (vkWaitForFences(m_device.getLogicalDevice(), 1, &m_frames[imageFrame].fence, VK_TRUE, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to wait for frame fence");
+		}
+	}
+	m_imageFrames[imageIndex] = m_frameIndex;
+
+	// The slot's fence has signalled, so is everything its previous frame allocated
+	m_frameAllocator.beginFrame(m_frameIndex);
+	updateUniformBuffer(m_frameIndex);
+	m_frameAllocator.flush();
+	m_commandPools.beginFrame(m_frameIndex);
+	VkCommandBuffer commandBuffer = m_commandPools.allocate(0);
+	recordCommandBuffer(commandBuffer, imageIndex, m_frameIndex);
+
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	VkSemaphore waitSemaphores[] = { m_imageAvailableSemaphore };
+	VkSemaphore waitSemaphores[] = { frame.imageAvailable };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 	submitInfo.waitSemaphoreCount = 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &m_commandBuffers[imageIndex];
-	VkSemaphore signalSemaphores[] = { m_renderFinishedSemaphore };
+	submitInfo.pCommandBuffers = &commandBuffer;
+	VkSemaphore signalSemaphores[] = { frame.renderFinished };
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	//TODO: add something better
-	
-
-	if (vkQueueSubmit(m_device.getGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	if (vkQueueSubmit(m_device.getGraphicsQueue(), 1, &submitInfo, frame.fence) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to submit draw command buffer");
 	}
+	frame.deletionFrame = m_deletionQueue.endFrame();
+	m_frameIndex = (m_frameIndex + 1) % static_cast<uint32_t>(m_frames.size());
 
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1124,6 +1337,26 @@ void BaseApplication::checkExtensions()
 	}
 #endif
 
+	if (m_headless)
+	{
+		// Nothing is presented, and a loader without a display may not offer the surface extensions at all
+		m_extensions = { VK_EXT_DEBUG_REPORT_EXTENSION_NAME };
+	}
+
+	// Lets the device report the driver's memory budget
+	for (const auto& extension : extensions)
+	{
+		if (strcmp(extension.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0)
+		{
+			m_extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		}
+	}
+
+	if (m_headless)
+	{
+		return;
+	}
+
 #if defined(_WIN32)
 	m_extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 #elif defined(__ANDROID__)
@@ -5,9 +5,18 @@
 #include "SDL_syswm.h"
 
 #include "Device.h"
+#include "UploadManager.h"
+#include "GpuDefragmenter.h"
+#include "FrameAllocator.h"
+#include "DeletionQueue.h"
+#include "FrameCommandPools.h"
+#include "Parallel.h"
 #include "Swapchain.h"
 #include "Vertex.h"
 #include "Camera.h"
+#include "Fluid.h"
+
+class FluidFrameRing;
 
 
 inline VkResult CreateDebugReportCallbackEXT(VkInstance instance, const VkDebugReportCallbackCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugReportCallbackEXT* pCallback) {
@@ -20,7 +29,7 @@ inline VkResult CreateDebugReportCallbackEXT(VkInstance instance, const VkDebugR
 	}
 }
 
-inline void DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT callback, const VkAllocationCallbacks* pAllocator) {
+inline VKAPI_ATTR void VKAPI_CALL DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT callback, const VkAllocationCallbacks* pAllocator) {
 	auto func = (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT");
 	if (func != nullptr) {
 		func(instance, callback, pAllocator);
@@ -34,6 +43,25 @@ struct SwapchainSupportDetails
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
+// Where one entity's triangles sit in the shared vertex and index buffers
+struct EntityDraw
+{
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+};
+
+// Compute-only run: one fluid is simulated and written to disk, nothing is drawn
+struct HeadlessSettings
+{
+	FluidParticle particle;
+	FluidParams params;
+	uint32_t stepsCount;
+	std::string statsFilename;
+	std::string recordingFilename;// empty skips the recording
+	std::string frameRingName;// empty skips publishing frames to other processes
+};
+
 class BaseApplication
 {
 public:
@@ -41,10 +69,16 @@ public:
 	~BaseApplication();
 
 	void run();
+	// No SDL window, surface or swapchain, and a device with only a compute queue, for nodes without a display
+	void runHeadless(const HeadlessSettings& settings);
+	// Renders the fluid another process publishes under frameRingName, see FluidFrameRing
+	void runViewer(const std::string& frameRingName);
 
 private:
 	void createWindow();
 	void initVulkan();
+	void initComputeVulkan();
+	void simulate(const HeadlessSettings& settings);
 	void createVulkanInstance();
 	void setupDebugCallback();
 	void createSurface();
@@ -54,32 +88,41 @@ private:
 	void createRenderPass();
 	void createDescriptionSetLayout();
 	void createGraphicsPipeline();
-	void createShaderModule(const std::vector<char>& code, Cleaner<VkShaderModule>& shaderModule);
+	void createShaderModule(const std::vector<char>& code, DeviceCleaner<VkShaderModule, vkDestroyShaderModule>& shaderModule);
 	void createFrameBuffers();
 	//void createCommandPool();
 
 	void createVertexBuffer();
 	void createIndexBuffer();
-	void createUniformBuffer();
+	void createFrameAllocator();
 	void createDescriptorPool();
 	void createDescriptorSet();
+	void updateDescriptorSet();
 
-	void createCommandBuffers();
-	void createSemaphores();
+	void createCommandPools();
+	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t frame);
+	// Records entities [begin, end) into a secondary buffer of thread's pool, to run inside the render pass
+	VkCommandBuffer recordEntities(uint32_t imageIndex, uint32_t frame, uint32_t thread, size_t begin, size_t end);
+	void createFrames();
+	uint32_t getFramesInFlight() const;
 
 	void checkExtensions();
 	void recreateSwapchain();
+	void retireSwapchainResources();
 
 	/*void createBuffer(
 		VkDeviceSize size,
 		VkBufferUsageFlags usageFlags,
 		VkMemoryPropertyFlags propertyFlags,
-		Cleaner<VkBuffer>& buffer,
-		Cleaner<VkDeviceMemory>& bufferMemory);
+		DeviceCleaner<VkBuffer, vkDestroyBuffer>& buffer,
+		DeviceCleaner<VkDeviceMemory, vkFreeMemory>& bufferMemory);
 	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);*/
 
 	void loop();
+	void updateViewedFluid();
 	void draw();
+	void updateUniformBuffer(uint32_t frame);
+	void onBufferMoved(VkBuffer buffer);
 
 	bool checkValidationLayerSupport();
 	//bool checkPhysicalDeviceExctensionSupport(VkPhysicalDevice physicalDevice);
@@ -95,49 +138,65 @@ private:
 	VkPresentModeKHR getSwapchainPresentMode(const std::vector<VkPresentModeKHR>& surfacePresentModes);
 	VkExtent2D getSwapchainExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 
-	Window* m_window;
+	Window* m_window = nullptr;
 	bool m_running = true;
+	bool m_headless = false;
 	SDL_SysWMinfo m_info;
-	Cleaner<VkInstance> m_instance{ vkDestroyInstance };
-	Cleaner<VkDebugReportCallbackEXT> m_callback{ m_instance, DestroyDebugReportCallbackEXT};
+	RootCleaner<VkInstance, vkDestroyInstance> m_instance;
+	InstanceCleaner<VkDebugReportCallbackEXT, DestroyDebugReportCallbackEXT> m_callback;
 	///Swapchain m_swapchain;
-	Cleaner<VkSurfaceKHR> m_surface{ m_instance, vkDestroySurfaceKHR };
+	InstanceCleaner<VkSurfaceKHR, vkDestroySurfaceKHR> m_surface;
 	//VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
-	//Cleaner<VkDevice> m_logicalDevice{ vkDestroyDevice };
+	//RootCleaner<VkDevice, vkDestroyDevice> m_logicalDevice;
 	Device m_device;
+	UploadManager m_uploads{ m_device };
+	// Right after the device, so it is the last to go before it
+	DeletionQueue m_deletionQueue;
 	
-	Cleaner<VkSwapchainKHR> m_swapchain{ m_device.getLogicalDevice(), vkDestroySwapchainKHR };
+	DeviceCleaner<VkSwapchainKHR, vkDestroySwapchainKHR> m_swapchain;
 	//VkQueue m_graphicsQueue;
 	//VkQueue m_presentQueue;
 	std::vector<VkImage> m_swapchainImages;
 	VkFormat m_swapchainImageFormat;
 	VkExtent2D m_swapchainExtent;
-	std::vector<Cleaner<VkImageView>> m_swapchainImageViews;
-	Cleaner<VkShaderModule> m_vertexShaderModule{ m_device.getLogicalDevice(), vkDestroyShaderModule };
-	Cleaner<VkShaderModule> m_fragmentShaderModule{ m_device.getLogicalDevice(), vkDestroyShaderModule };
-	Cleaner<VkDescriptorSetLayout> m_descriptorSetLayout{ m_device.getLogicalDevice(), vkDestroyDescriptorSetLayout};
-	Cleaner<VkPipelineLayout> m_pipelineLayout{ m_device.getLogicalDevice(), vkDestroyPipelineLayout };
-	Cleaner<VkRenderPass> m_renderPass{ m_device.getLogicalDevice(), vkDestroyRenderPass };
-	Cleaner<VkPipeline> m_graphicsPipeline{ m_device.getLogicalDevice(), vkDestroyPipeline };
-	std::vector<Cleaner<VkFramebuffer>> m_swapchainFramebuffers;
-	//Cleaner<VkCommandPool> m_commandPool{ m_device.getLogicalDevice(), vkDestroyCommandPool };
-
-	Cleaner<VkBuffer> m_vertexBuffer{ m_device.getLogicalDevice(), vkDestroyBuffer };
-	Cleaner<VkDeviceMemory> m_vertexBufferMemory{ m_device.getLogicalDevice(), vkFreeMemory };
-	Cleaner<VkBuffer> m_indexBuffer{ m_device.getLogicalDevice(), vkDestroyBuffer };
-	Cleaner<VkDeviceMemory> m_indexBufferMemory{ m_device.getLogicalDevice(), vkFreeMemory };
-	Cleaner<VkBuffer> m_uniformStagingBuffer{ m_device.getLogicalDevice(), vkDestroyBuffer };
-	Cleaner<VkDeviceMemory> m_uniformStagingBufferMemory{ m_device.getLogicalDevice(), vkFreeMemory };
-	Cleaner<VkBuffer> m_uniformBuffer{ m_device.getLogicalDevice(), vkDestroyBuffer };
-	Cleaner<VkDeviceMemory> m_uniformBufferMemory{ m_device.getLogicalDevice(), vkFreeMemory };
+	std::vector<DeviceCleaner<VkImageView, vkDestroyImageView>> m_swapchainImageViews;
+	DeviceCleaner<VkShaderModule, vkDestroyShaderModule> m_vertexShaderModule;
+	DeviceCleaner<VkShaderModule, vkDestroyShaderModule> m_fragmentShaderModule;
+	DeviceCleaner<VkDescriptorSetLayout, vkDestroyDescriptorSetLayout> m_descriptorSetLayout;
+	DeviceCleaner<VkPipelineLayout, vkDestroyPipelineLayout> m_pipelineLayout;
+	DeviceCleaner<VkRenderPass, vkDestroyRenderPass> m_renderPass;
+	DeviceCleaner<VkPipeline, vkDestroyPipeline> m_graphicsPipeline;
+	std::vector<DeviceCleaner<VkFramebuffer, vkDestroyFramebuffer>> m_swapchainFramebuffers;
+	//DeviceCleaner<VkCommandPool, vkDestroyCommandPool> m_commandPool;
+
+	DeviceCleaner<VkBuffer, vkDestroyBuffer> m_vertexBuffer;
+	RootCleaner<GpuAllocation, freeGpuAllocation> m_vertexBufferAllocation;
+	DeviceCleaner<VkBuffer, vkDestroyBuffer> m_indexBuffer;
+	RootCleaner<GpuAllocation, freeGpuAllocation> m_indexBufferAllocation;
+	// One slot per frame in flight; each frame's uniforms are its first allocation, written right before the draw
+	FrameAllocator m_frameAllocator{ m_device };
+	// Declared after the buffers it tracks, so it lets go of them first
+	GpuDefragmenter m_defragmenter{ m_device };
 	
 
-	Cleaner<VkDescriptorPool> m_descriptorPool{ m_device.getLogicalDevice(), vkDestroyDescriptorPool };
+	DeviceCleaner<VkDescriptorPool, vkDestroyDescriptorPool> m_descriptorPool;
 	VkDescriptorSet m_descriptorSet;
 
-	std::vector<VkCommandBuffer> m_commandBuffers;
-	Cleaner<VkSemaphore> m_imageAvailableSemaphore{ m_device.getLogicalDevice(), vkDestroySemaphore };
-	Cleaner<VkSemaphore> m_renderFinishedSemaphore{ m_device.getLogicalDevice(), vkDestroySemaphore };
+	// Per frame in flight, reset once the frame's fence has signalled; recording worker t uses slot t
+	FrameCommandPools m_commandPools{ m_device };
+	std::unique_ptr<WorkerPool> m_recordWorkers;
+	struct FrameInFlight
+	{
+		VkSemaphore imageAvailable;
+		VkSemaphore renderFinished;
+		// Signalled when the frame's draw is done, so its uniform slot, command buffers and semaphores are free again
+		VkFence fence;
+		uint64_t deletionFrame;// deletion queue frame last submitted with the fence, 0 while nothing is pending
+	};
+	std::vector<FrameInFlight> m_frames;// owned by the device pools
+	uint32_t m_frameIndex = 0;
+	// Frame slot that last drew into each image; images may come back out of order, while that frame is still pending
+	std::vector<uint32_t> m_imageFrames;
 
 	std::vector<Vertex> m_vertices = 
 	{
@@ -150,9 +209,21 @@ private:
 	{
 		0, 1, 2, 2, 3, 0
 	};
+	std::vector<EntityDraw> m_entityDraws;
+	// Below this many draws another recording thread costs more than it saves
+	static const size_t minDrawsPerThread = 256;
+	// Recording threads besides the main one
+	static const uint32_t maxRecordWorkers = 4;
+	// Frames recorded ahead of the GPU, fewer when the swapchain has fewer images
+	static const uint32_t maxFramesInFlight = 2;
+	static const uint32_t noFrame = ~0u;
 
 	std::vector<Camera*> m_cameras;
 
+	std::string m_frameRingName;
+	std::unique_ptr<FluidFrameRing> m_frameRing;
+	std::unique_ptr<Fluid> m_viewedFluid;
+
 	const std::vector<const char*> m_validationLayers = {
 		"VK_LAYER_LUNARG_core_validation"
 	};
@@ -1,2 +1,5 @@
 #include "Cleaner.h"
 
+static_assert(sizeof(RootCleaner<VkInstance, vkDestroyInstance>) == sizeof(VkInstance), "a root cleaner is just its handle");
+static_assert(sizeof(void*) != sizeof(uint64_t) || sizeof(DeviceCleaner<VkBuffer, vkDestroyBuffer>) == sizeof(VkDevice) + sizeof(VkBuffer),
+	"a child cleaner is its handle and its parent");
@@ -1,32 +1,56 @@
 #pragma once
 
 #include "Window.h"
-#include <iostream>
-#include <stdexcept>
 #include <functional>
+#include <memory>
 
-template <typename T>
-class Cleaner
+// Deleters are picked at compile time: destroying costs one direct call, and all a Cleaner stores next to the handle
+// is the parent it was created from, if any
+template <typename T, void (VKAPI_PTR *Destroy)(T, const VkAllocationCallbacks*)>
+struct RootDeleter
 {
-public:
-	Cleaner() : Cleaner([](T, VkAllocationCallbacks*) {}) {};
-
-	Cleaner(std::function<void(T, VkAllocationCallbacks*)> deletef)
+	void operator()(T object) const
 	{
-		m_cleaner = [=](T obj) { deletef(obj, nullptr); };
+		Destroy(object, nullptr);
 	}
+};
+
+template <typename P, typename T, void (VKAPI_PTR *Destroy)(P, T, const VkAllocationCallbacks*)>
+struct ChildDeleter
+{
+	P parent = VK_NULL_HANDLE;
 
-	Cleaner(const Cleaner<VkInstance>& instance, std::function<void(VkInstance, T, VkAllocationCallbacks*)> deletef)
+	void operator()(T object) const
 	{
-		m_cleaner = [&instance, deletef](T obj) { deletef(instance, obj, nullptr); };
+		Destroy(parent, object, nullptr);
 	}
+};
+
+// Move-only owner of one handle. Child objects get their parent when they are created, through data(parent) or
+// reset(parent, object)
+template <typename T, typename Deleter>
+class Cleaner : private Deleter
+{
+public:
+	Cleaner() = default;
 
-	Cleaner(const Cleaner<VkDevice>& device, std::function<void(VkDevice, T, VkAllocationCallbacks*)> deletef)
+	Cleaner(const Cleaner&) = delete;
+	Cleaner& operator=(const Cleaner&) = delete;
+
+	Cleaner(Cleaner&& other) noexcept : Deleter(static_cast<const Deleter&>(other)), m_object(other.release()) {}
+
+	Cleaner& operator=(Cleaner&& other) noexcept
 	{
-		m_cleaner = [&device, deletef](T obj) { deletef(device, obj, nullptr); };
+		if (this != std::addressof(other))
+		{
+			cleanup();
+			Deleter::operator=(static_cast<const Deleter&>(other));
+			m_object = other.release();
+		}
+		return *this;
 	}
 
-	~Cleaner() 
+	~Cleaner()
 	{
 		cleanup();
 	}
@@ -36,21 +60,59 @@ public:
 		return &m_object;
 	}
 
+	// Destroys the current object and returns where to create the new one
 	T* data()
 	{
 		cleanup();
 		return &m_object;
 	}
 
+	template <typename D = Deleter>
+	T* data(decltype(D::parent) parent)
+	{
+		cleanup();
+		Deleter::parent = parent;
+		return &m_object;
+	}
+
 	operator T() const
 	{
 		return m_object;
 	}
 
-	void operator=(T rhs)
+	// Takes over object, a child object keeps the parent of the one it replaces
+	void reset(T object = VK_NULL_HANDLE)
+	{
+		cleanup();
+		m_object = object;
+	}
+
+	template <typename D = Deleter>
+	void reset(decltype(D::parent) parent, T object)
 	{
 		cleanup();
-		m_object = rhs;
+		Deleter::parent = parent;
+		m_object = object;
+	}
+
+	// Gives up ownership without destroying the object
+	T release()
+	{
+		T object = m_object;
+		m_object = VK_NULL_HANDLE;
+		return object;
+	}
+
+	// Gives up ownership, the returned function destroys the object whenever it is called; empty when there is none
+	std::function<void()> detach()
+	{
+		if (m_object == VK_NULL_HANDLE)
+		{
+			return std::function<void()>();
+		}
+		Deleter deleter = *this;
+		T object = release();
+		return [deleter, object]() { deleter(object); };
 	}
 
 	template<typename V>
@@ -61,15 +123,22 @@ public:
 
 private:
 	T m_object{ VK_NULL_HANDLE };
-	std::function<void(T)> m_cleaner;
 
 	void cleanup()
 	{
 		if (m_object != VK_NULL_HANDLE)
 		{
-			m_cleaner(m_object);
+			Deleter::operator()(m_object);
 		}
 		m_object = VK_NULL_HANDLE;
 	}
 };
 
+template <typename T, void (VKAPI_PTR *Destroy)(T, const VkAllocationCallbacks*)>
+using RootCleaner = Cleaner<T, RootDeleter<T, Destroy>>;
+
+template <typename T, void (VKAPI_PTR *Destroy)(VkInstance, T, const VkAllocationCallbacks*)>
+using InstanceCleaner = Cleaner<T, ChildDeleter<VkInstance, T, Destroy>>;
+
+template <typename T, void (VKAPI_PTR *Destroy)(VkDevice, T, const VkAllocationCallbacks*)>
+using DeviceCleaner = Cleaner<T, ChildDeleter<VkDevice, T, Destroy>>;
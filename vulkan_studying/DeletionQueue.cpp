@@ -0,0 +1,72 @@
+#include "DeletionQueue.h"
+
+
+DeletionQueue::~DeletionQueue()
+{
+	flush();
+}
+
+void DeletionQueue::retire(std::function<void()> destroy)
+{
+	if (!destroy)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Entry entry;
+	entry.frame = m_frame;
+	entry.destroy = std::move(destroy);
+	m_entries.push_back(std::move(entry));
+}
+
+uint64_t DeletionQueue::getFrame() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_frame;
+}
+
+uint64_t DeletionQueue::endFrame()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_frame++;
+}
+
+void DeletionQueue::collect(uint64_t completedFrame)
+{
+	std::deque<Entry> completed;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_completedFrame = std::max(m_completedFrame, completedFrame);
+		while (!m_entries.empty() && m_entries.front().frame <= m_completedFrame)
+		{
+			completed.push_back(std::move(m_entries.front()));
+			m_entries.pop_front();
+		}
+	}
+
+	// Destroyed outside the lock, a destructor may well retire something itself
+	for (auto& entry : completed)
+	{
+		entry.destroy();
+	}
+}
+
+void DeletionQueue::flush()
+{
+	std::deque<Entry> entries;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		entries.swap(m_entries);
+	}
+	for (auto& entry : entries)
+	{
+		entry.destroy();
+	}
+}
+
+size_t DeletionQueue::getPendingCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_entries.size();
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "Headers.h"
+#include "Cleaner.h"
+#include <deque>
+#include <mutex>
+
+// Destroys Vulkan objects once the GPU is done with them instead of draining the device. Whatever is retired belongs
+// to the frame being built; the owner of the frame fences reports the frames it has seen complete, and everything
+// retired up to such a frame is destroyed then. Frames finish in submission order, so one number is enough
+class DeletionQueue
+{
+public:
+	// Destroys whatever is left, the device must be idle by then
+	~DeletionQueue();
+
+	void retire(std::function<void()> destroy);
+	template<typename T, typename Deleter>
+	void retire(Cleaner<T, Deleter>& object) { retire(object.detach()); }
+
+	// The frame retired objects are tagged with, numbering starts at 1
+	uint64_t getFrame() const;
+	// Call after submitting the frame; returns its number, later retirements go to the next frame
+	uint64_t endFrame();
+	// Destroys everything retired up to completedFrame, whose fence has signalled
+	void collect(uint64_t completedFrame);
+	// Destroys everything, for when the device is idle
+	void flush();
+
+	size_t getPendingCount() const;
+
+private:
+	struct Entry
+	{
+		uint64_t frame;
+		std::function<void()> destroy;
+	};
+
+	std::deque<Entry> m_entries;// oldest frame first
+	uint64_t m_frame = 1;
+	uint64_t m_completedFrame = 0;
+
+	mutable std::mutex m_mutex;
+};
@@ -14,6 +14,18 @@ uint32_t Device::getMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags proper
 	throw std::runtime_error("failed to find suitable memory type");
 }
 
+bool Device::hasMemoryType(VkMemoryPropertyFlags propertyFlags) const
+{
+	for (uint32_t i = 0; i < m_physicalDeviceMemoryProperties.memoryTypeCount; i++)
+	{
+		if ((m_physicalDeviceMemoryProperties.memoryTypes[i].propertyFlags & propertyFlags) == propertyFlags)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 uint32_t Device::getQueueFamilyIndex(VkQueueFlagBits queueFlag)
 {
 	//std::cout << static_cast<uint32_t>(m_queueFamilyProperties.size()) << std::endl;
@@ -74,7 +86,7 @@ VkCommandPool Device::createCommandPool(uint32_t queueFamilyIndex, VkCommandPool
 }
 
 void Device::createBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags propertyFlags,
-	Cleaner<VkBuffer>& buffer, Cleaner<VkDeviceMemory>& bufferMemory, void* data)
+	DeviceCleaner<VkBuffer, vkDestroyBuffer>& buffer, RootCleaner<GpuAllocation, freeGpuAllocation>& bufferAllocation, void* data)
 {
 	VkBufferCreateInfo bufferCreateInfo = {};
 	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -82,7 +94,7 @@ void Device::createBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMe
 	bufferCreateInfo.usage = usageFlags;
 	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	if (vkCreateBuffer(m_logicalDevice, &bufferCreateInfo, nullptr, buffer.data()) != VK_SUCCESS)
+	if (vkCreateBuffer(m_logicalDevice, &bufferCreateInfo, nullptr, buffer.data(m_logicalDevice)) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create buffer");
 	}
@@ -90,109 +102,170 @@ void Device::createBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMe
 	VkMemoryRequirements memoryRequirments;
 	vkGetBufferMemoryRequirements(m_logicalDevice, buffer, &memoryRequirments);
 
-	VkMemoryAllocateInfo memoryAllocateInfo = {};
-	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocateInfo.allocationSize = memoryRequirments.size;
-	memoryAllocateInfo.memoryTypeIndex = getMemoryType(memoryRequirments.memoryTypeBits, propertyFlags);
+	bufferAllocation.reset(m_allocator.allocate(memoryRequirments, propertyFlags));
+	GpuAllocation allocation = bufferAllocation;
 
-	if (vkAllocateMemory(m_logicalDevice, &memoryAllocateInfo, nullptr, bufferMemory.data()) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to allocate buffer memory");
-	}
-
-	// If a pointer to the buffer data has been passed, map the buffer and copy over the data
+	// If a pointer to the buffer data has been passed, copy it through the block's persistent mapping
 	if (data != nullptr)
 	{
-		void *mapped;
-		if(vkMapMemory(m_logicalDevice, bufferMemory, 0, size, 0, &mapped)!=VK_SUCCESS)
+		if (allocation->mapped == nullptr)
 		{
 			throw std::runtime_error("failed to map memory");
 		}
-		memcpy(mapped, data, size);
+		memcpy(allocation->mapped, data, size);
 		// If host coherency hasn't been requested, do a manual flush to make writes visible
-		if ((propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
-		{
-			VkMappedMemoryRange mappedRange = {};
-			mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-			mappedRange.memory = bufferMemory;
-			mappedRange.offset = 0;
-			mappedRange.size = size;
-			vkFlushMappedMemoryRanges(m_logicalDevice, 1, &mappedRange);
-		}
-		vkUnmapMemory(m_logicalDevice, bufferMemory);
+		m_allocator.flush(allocation, 0, size);
 	}
 
-	if (vkBindBufferMemory(m_logicalDevice, buffer, bufferMemory, 0) != VK_SUCCESS)
+	if (vkBindBufferMemory(m_logicalDevice, buffer, allocation->memory, allocation->offset) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to bind buffer memory");
 	}
 }
 
-void Device::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+Device::Device()
 {
-	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
-	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	commandBufferAllocateInfo.commandPool = m_commandPool;
-	commandBufferAllocateInfo.commandBufferCount = 1;
-
-	VkCommandBuffer commandBuffer;
-	if (vkAllocateCommandBuffers(m_logicalDevice, &commandBufferAllocateInfo, &commandBuffer) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to allocate command buffers");
-	}
+}
 
-	VkCommandBufferBeginInfo cmdBufferBeginInfo = {};
-	cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	cmdBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-	if (vkBeginCommandBuffer(commandBuffer, &cmdBufferBeginInfo) != VK_SUCCESS)
+void Device::init(VkInstance instance, std::vector<VkPhysicalDevice>& physicalDevices, bool useSwapchain, VkQueueFlags requestedQueueTypes)
+{
+	if (!useSwapchain)
 	{
-		throw std::runtime_error("failed to begin command buffer");
+		// Drivers without a display need not expose the extension, so it must not count against suitability either
+		m_enabledExtentions.erase(std::remove_if(m_enabledExtentions.begin(), m_enabledExtentions.end(),
+			[](const char* extension) { return strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0; }),
+			m_enabledExtentions.end());
 	}
 
-	VkBufferCopy copyRegion = {};
-	copyRegion.srcOffset = 0;
-	copyRegion.dstOffset = 0;
-	copyRegion.size = size;
+	selectPhysicalDevice(physicalDevices);
+	enableMemoryBudget(instance);
+	createLogicalDevice(m_enabledFeatures, m_enabledExtentions, useSwapchain, requestedQueueTypes);
+	m_allocator.init(m_physicalDevice, m_logicalDevice);
+}
 
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+Device::~Device()
+{
+}
 
-	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+void Device::enableMemoryBudget(VkInstance instance)
+{
+#ifdef VK_EXT_memory_budget
+	// The query comes from VK_KHR_get_physical_device_properties2, the instance only hands it out when that is enabled
+	auto getMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(
+		vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+	if (getMemoryProperties2 == nullptr)
 	{
-		throw std::runtime_error("failed to end command buffer");
+		return;
 	}
 
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	uint32_t extensionsCount = 0;
+	vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionsCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionsCount);
+	vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionsCount, extensions.data());
+	for (const auto& extension : extensions)
 	{
-		throw std::runtime_error("failed to submit queue");
+		if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+		{
+			m_enabledExtentions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+			m_getMemoryProperties2 = getMemoryProperties2;
+			return;
+		}
 	}
-	if (vkQueueWaitIdle(m_graphicsQueue) != VK_SUCCESS)
+#endif
+}
+
+GpuMemoryStats Device::getMemoryStats()
+{
+	GpuMemoryStats stats = m_allocator.getStats();
+	stats.hasBudget = false;
+
+#ifdef VK_EXT_memory_budget
+	if (m_getMemoryProperties2 != nullptr)
 	{
-		throw std::runtime_error("failed at wait idle");
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+		budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+		VkPhysicalDeviceMemoryProperties2KHR properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+		properties.pNext = &budget;
+		m_getMemoryProperties2(m_physicalDevice, &properties);
+
+		for (size_t i = 0; i < stats.heaps.size(); i++)
+		{
+			stats.heaps[i].budget = budget.heapBudget[i];
+			stats.heaps[i].processUsage = budget.heapUsage[i];
+		}
+		stats.hasBudget = true;
 	}
-
-	vkFreeCommandBuffers(m_logicalDevice, m_commandPool, 1, &commandBuffer);
+#endif
+	return stats;
 }
 
-Device::Device()
+void Device::printMemoryStats(std::ostream& stream)
 {
-}
+	GpuMemoryStats stats = getMemoryStats();
+	const double megabyte = 1024.0 * 1024.0;
 
+	stream << "GPU memory:" << std::endl;
+	for (size_t i = 0; i < stats.heaps.size(); i++)
+	{
+		const GpuMemoryHeapStats& heap = stats.heaps[i];
+		stream << "\theap " << i << ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "") << ": "
+			<< heap.usage.usedBytes / megabyte << " MB used of " << heap.usage.allocatedBytes / megabyte << " MB allocated, "
+			<< heap.size / megabyte << " MB heap";
+		if (stats.hasBudget)
+		{
+			stream << ", budget " << heap.budget / megabyte << " MB with " << heap.processUsage / megabyte << " MB in use by the process";
+		}
+		stream << std::endl;
 
-void Device::init(std::vector<VkPhysicalDevice>& physicalDevices)
-{
-	selectPhysicalDevice(physicalDevices);
-	createLogicalDevice(m_enabledFeatures, m_enabledExtentions);
+		for (size_t j = 0; j < stats.types.size(); j++)
+		{
+			const GpuMemoryTypeStats& type = stats.types[j];
+			if (type.heapIndex != i || type.usage.blocksCount == 0)
+			{
+				continue;
+			}
+			stream << "\t\ttype " << j << " (flags " << type.propertyFlags << "): " << type.usage.allocationsCount << " allocations in "
+				<< type.usage.blocksCount << " blocks, " << type.usage.usedBytes / megabyte << " MB of " << type.usage.allocatedBytes / megabyte
+				<< " MB, largest free " << type.usage.largestFreeRange / megabyte << " MB, fragmentation " << type.usage.fragmentation << std::endl;
+		}
+	}
 }
 
-Device::~Device()
+void Device::writeMemoryStatsJson(std::ostream& stream)
 {
+	GpuMemoryStats stats = getMemoryStats();
+
+	auto writeUsage = [&stream](const GpuMemoryUsage& usage)
+	{
+		stream << "\"blocks\":" << usage.blocksCount << ",\"allocations\":" << usage.allocationsCount
+			<< ",\"allocatedBytes\":" << usage.allocatedBytes << ",\"usedBytes\":" << usage.usedBytes
+			<< ",\"largestFreeRange\":" << usage.largestFreeRange << ",\"fragmentation\":" << usage.fragmentation;
+	};
+
+	stream << "{\"heaps\":[";
+	for (size_t i = 0; i < stats.heaps.size(); i++)
+	{
+		const GpuMemoryHeapStats& heap = stats.heaps[i];
+		stream << (i > 0 ? "," : "") << "{\"size\":" << heap.size << ",\"deviceLocal\":"
+			<< ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "true" : "false") << ',';
+		writeUsage(heap.usage);
+		if (stats.hasBudget)
+		{
+			stream << ",\"budget\":" << heap.budget << ",\"processUsage\":" << heap.processUsage;
+		}
+		stream << '}';
+	}
+	stream << "],\"types\":[";
+	for (size_t i = 0; i < stats.types.size(); i++)
+	{
+		const GpuMemoryTypeStats& type = stats.types[i];
+		stream << (i > 0 ? "," : "") << "{\"heap\":" << type.heapIndex << ",\"propertyFlags\":" << type.propertyFlags << ',';
+		writeUsage(type.usage);
+		stream << '}';
+	}
+	stream << "]}" << std::endl;
 }
 
 /*Device::QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
@@ -324,7 +397,8 @@ void Device::createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::
 	}
 	else
 	{
-		queueFamilyIndices.graphicsFamily = VK_NULL_HANDLE;
+		// Not a valid index, so a compute family 0 still gets its own queue below
+		queueFamilyIndices.graphicsFamily = VK_QUEUE_FAMILY_IGNORED;
 	}
 
 	// Dedicated compute queue
@@ -354,7 +428,7 @@ void Device::createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::
 		queueFamilyIndices.transferFamily = getQueueFamilyIndex(VK_QUEUE_TRANSFER_BIT);
 		if ((queueFamilyIndices.transferFamily != queueFamilyIndices.graphicsFamily) && (queueFamilyIndices.transferFamily != queueFamilyIndices.computeFamily))
 		{
-			// If compute family index differs, we need an additional queue create info for the compute queue
+			// If transfer family index differs, we need an additional queue create info for the transfer queue
 			VkDeviceQueueCreateInfo queueInfo{};
 			queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 			queueInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
@@ -365,8 +439,8 @@ void Device::createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::
 	}
 	else
 	{
-		// Else we use the same queue
-		queueFamilyIndices.transferFamily = queueFamilyIndices.graphicsFamily;
+		// Else we use the same queue, the compute one on compute only devices
+		queueFamilyIndices.transferFamily = (requestedQueueTypes & VK_QUEUE_GRAPHICS_BIT) ? queueFamilyIndices.graphicsFamily : queueFamilyIndices.computeFamily;
 	}
 
 	VkDeviceCreateInfo deviceCreateInfo = {};
@@ -392,11 +466,14 @@ void Device::createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::
 	{
 		throw std::runtime_error("failed to create logical device");
 	}	
+	m_pools.init(m_logicalDevice);
 
-	m_commandPool = createCommandPool(queueFamilyIndices.graphicsFamily);
-
-	vkGetDeviceQueue(m_logicalDevice, queueFamilyIndices.graphicsFamily, 0, &m_graphicsQueue);
+	if (requestedQueueTypes & VK_QUEUE_GRAPHICS_BIT)
+	{
+		vkGetDeviceQueue(m_logicalDevice, queueFamilyIndices.graphicsFamily, 0, &m_graphicsQueue);
+	}
 	vkGetDeviceQueue(m_logicalDevice, queueFamilyIndices.computeFamily, 0, &m_computeQueue);
+	vkGetDeviceQueue(m_logicalDevice, queueFamilyIndices.transferFamily, 0, &m_transferQueue);
 }
 
 bool Device::isPhysicalDeviceSuitable(VkPhysicalDevice physicalDevice)
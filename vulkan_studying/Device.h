@@ -1,6 +1,8 @@
 #pragma once
 #include "Headers.h"
 #include "Cleaner.h"
+#include "GpuAllocator.h"
+#include "DevicePools.h"
 #include <vulkan/vulkan.h>
 
 #ifdef NDEBUG
@@ -19,26 +21,38 @@ public:
 		uint32_t transferFamily;
 	} queueFamilyIndices;
 
-	void init(std::vector<VkPhysicalDevice>& physicalDevices);
+	// Headless compute nodes pass useSwapchain = false and VK_QUEUE_COMPUTE_BIT: no swapchain extension and no graphics queue.
+	// VK_QUEUE_TRANSFER_BIT asks for a transfer-only (DMA) family when there is one, its queue is getTransferQueue().
+	// The instance is only asked for entry points, such as the memory budget query when it enabled properties2
+	void init(VkInstance instance, std::vector<VkPhysicalDevice>& physicalDevices, bool useSwapchain = true, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
 
 	VkPhysicalDevice& getPhysicalDevice() { return m_physicalDevice; }
-	Cleaner<VkDevice>& getLogicalDevice() { return m_logicalDevice; }
-	VkCommandPool& getCommandPool() { return m_commandPool; }
+	VkDevice getLogicalDevice() const { return m_logicalDevice; }
 	VkQueue& getGraphicsQueue() { return m_graphicsQueue; }
 	VkQueue& getComputeQueue() { return m_computeQueue; }
+	VkQueue& getTransferQueue() { return m_transferQueue; }
+	GpuAllocator& getAllocator() { return m_allocator; }
+	DevicePools& getPools() { return m_pools; }
+	const VkPhysicalDeviceProperties& getPhysicalDeviceProperties() const { return m_physicalDeviceProperties; }
+
+	// What createBuffer has taken from every heap and type, with the driver's budget where VK_EXT_memory_budget is enabled
+	GpuMemoryStats getMemoryStats();
+	void printMemoryStats(std::ostream& stream);
+	void writeMemoryStatsJson(std::ostream& stream);
 
 	uint32_t getMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags);
+	bool hasMemoryType(VkMemoryPropertyFlags propertyFlags) const;
 	uint32_t getQueueFamilyIndex(VkQueueFlagBits queueFlag);
 
 	VkCommandPool createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags createFlags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	// Memory comes from the device's GpuAllocator, the buffer is bound at its allocation's offset
 	void createBuffer(
 		VkDeviceSize size,
 		VkBufferUsageFlags usageFlags,
 		VkMemoryPropertyFlags propertyFlags,
-		Cleaner<VkBuffer>& buffer,
-		Cleaner<VkDeviceMemory>& bufferMemory,
+		DeviceCleaner<VkBuffer, vkDestroyBuffer>& buffer,
+		RootCleaner<GpuAllocation, freeGpuAllocation>& bufferAllocation,
 		void *data = nullptr);
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
 
 	Device();
@@ -53,18 +67,25 @@ private:
 
 	bool isPhysicalDeviceSuitable(VkPhysicalDevice);
 	bool checkPhysicalDeviceExctensionSupport(VkPhysicalDevice device);
+	void enableMemoryBudget(VkInstance instance);
 
-	Cleaner<VkDevice> m_logicalDevice{ vkDestroyDevice };
-
-	VkCommandPool m_commandPool = VK_NULL_HANDLE;
+	RootCleaner<VkDevice, vkDestroyDevice> m_logicalDevice;
+	// Declared after the device so its blocks are freed first
+	GpuAllocator m_allocator;
+	DevicePools m_pools;
 
 	VkPhysicalDevice m_physicalDevice;
 	VkPhysicalDeviceProperties m_physicalDeviceProperties;
 	VkPhysicalDeviceFeatures m_physicalDeviceFeatures;
 	VkPhysicalDeviceFeatures m_enabledFeatures = {};
 	VkPhysicalDeviceMemoryProperties m_physicalDeviceMemoryProperties;
-	VkQueue m_graphicsQueue;
-	VkQueue m_computeQueue;
+	VkQueue m_graphicsQueue = VK_NULL_HANDLE;
+	VkQueue m_computeQueue = VK_NULL_HANDLE;
+	VkQueue m_transferQueue = VK_NULL_HANDLE;
+
+#ifdef VK_EXT_memory_budget
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR m_getMemoryProperties2 = nullptr;
+#endif
 
 	std::vector<VkQueueFamilyProperties> m_queueFamilyProperties;
 
@@ -0,0 +1,221 @@
+#include "DevicePools.h"
+
+
+DevicePools::~DevicePools()
+{
+	destroy();
+}
+
+void DevicePools::init(VkDevice device)
+{
+	m_device = device;
+}
+
+void DevicePools::destroy()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (VkFence fence : m_fences)
+	{
+		vkDestroyFence(m_device, fence, nullptr);
+	}
+	for (VkSemaphore semaphore : m_semaphores)
+	{
+		vkDestroySemaphore(m_device, semaphore, nullptr);
+	}
+	for (auto& queryPools : m_queryPools)
+	{
+		for (VkQueryPool queryPool : queryPools.second.all)
+		{
+			vkDestroyQueryPool(m_device, queryPool, nullptr);
+		}
+	}
+	// Destroying a command pool frees its buffers
+	for (auto& commandPool : m_commandPools)
+	{
+		vkDestroyCommandPool(m_device, commandPool.second.commandPool, nullptr);
+	}
+
+	m_fences.clear();
+	m_freeFences.clear();
+	m_semaphores.clear();
+	m_freeSemaphores.clear();
+	m_queryPools.clear();
+	m_queryPoolKeys.clear();
+	m_commandPools.clear();
+}
+
+VkFence DevicePools::acquireFence(bool signaled)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_freeFences.empty() && !signaled)
+	{
+		VkFence fence = m_freeFences.back();
+		m_freeFences.pop_back();
+		return fence;
+	}
+
+	// A fence can't be signalled from the host, signalled ones are always new
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = signaled ? VK_FENCE_CREATE_SIGNALED_BIT : 0;
+
+	VkFence fence;
+	if (vkCreateFence(m_device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create fence");
+	}
+	m_fences.push_back(fence);
+	m_createdCount++;
+	return fence;
+}
+
+void DevicePools::releaseFence(VkFence fence)
+{
+	if (vkResetFences(m_device, 1, &fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to reset fence");
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_freeFences.push_back(fence);
+}
+
+VkSemaphore DevicePools::acquireSemaphore()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_freeSemaphores.empty())
+	{
+		VkSemaphore semaphore = m_freeSemaphores.back();
+		m_freeSemaphores.pop_back();
+		return semaphore;
+	}
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VkSemaphore semaphore;
+	if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create semaphore");
+	}
+	m_semaphores.push_back(semaphore);
+	m_createdCount++;
+	return semaphore;
+}
+
+void DevicePools::releaseSemaphore(VkSemaphore semaphore)
+{
+	// An unsignalled semaphore nobody waits on is as good as new
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_freeSemaphores.push_back(semaphore);
+}
+
+VkQueryPool DevicePools::acquireQueryPool(VkQueryType type, uint32_t queryCount, VkQueryPipelineStatisticFlags pipelineStatistics)
+{
+	QueryPoolKey key;
+	key.type = type;
+	key.queryCount = queryCount;
+	key.pipelineStatistics = type == VK_QUERY_TYPE_PIPELINE_STATISTICS ? pipelineStatistics : 0;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	QueryPools& queryPools = m_queryPools[key];
+	if (!queryPools.free.empty())
+	{
+		VkQueryPool queryPool = queryPools.free.back();
+		queryPools.free.pop_back();
+		return queryPool;
+	}
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = type;
+	queryPoolInfo.queryCount = queryCount;
+	queryPoolInfo.pipelineStatistics = key.pipelineStatistics;
+
+	VkQueryPool queryPool;
+	if (vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create query pool");
+	}
+	queryPools.all.push_back(queryPool);
+	m_queryPoolKeys[queryPool] = key;
+	m_createdCount++;
+	return queryPool;
+}
+
+void DevicePools::releaseQueryPool(VkQueryPool queryPool)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto key = m_queryPoolKeys.find(queryPool);
+	if (key == m_queryPoolKeys.end())
+	{
+		throw std::runtime_error("query pool does not belong to these pools");
+	}
+	m_queryPools[key->second].free.push_back(queryPool);
+}
+
+VkCommandBuffer DevicePools::acquireCommandBuffer(uint32_t queueFamilyIndex, VkCommandBufferLevel level)
+{
+	VkCommandBuffer commandBuffer;
+	acquireCommandBuffers(queueFamilyIndex, level, 1, &commandBuffer);
+	return commandBuffer;
+}
+
+void DevicePools::acquireCommandBuffers(uint32_t queueFamilyIndex, VkCommandBufferLevel level, uint32_t count, VkCommandBuffer* commandBuffers)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	CommandPool& commandPool = getCommandPool(queueFamilyIndex, level);
+
+	uint32_t recycled = std::min(count, static_cast<uint32_t>(commandPool.free.size()));
+	std::copy(commandPool.free.end() - recycled, commandPool.free.end(), commandBuffers);
+	commandPool.free.resize(commandPool.free.size() - recycled);
+	if (recycled == count)
+	{
+		return;
+	}
+
+	// Whatever is missing comes in a single allocation
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.commandPool = commandPool.commandPool;
+	allocateInfo.level = level;
+	allocateInfo.commandBufferCount = count - recycled;
+	if (vkAllocateCommandBuffers(m_device, &allocateInfo, commandBuffers + recycled) != VK_SUCCESS)
+	{
+		commandPool.free.insert(commandPool.free.end(), commandBuffers, commandBuffers + recycled);
+		throw std::runtime_error("failed to allocate command buffers");
+	}
+	m_createdCount += count - recycled;
+}
+
+void DevicePools::releaseCommandBuffers(uint32_t queueFamilyIndex, VkCommandBufferLevel level, uint32_t count, const VkCommandBuffer* commandBuffers)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	CommandPool& commandPool = getCommandPool(queueFamilyIndex, level);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (vkResetCommandBuffer(commandBuffers[i], 0) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to reset command buffer");
+		}
+	}
+	commandPool.free.insert(commandPool.free.end(), commandBuffers, commandBuffers + count);
+}
+
+DevicePools::CommandPool& DevicePools::getCommandPool(uint32_t queueFamilyIndex, VkCommandBufferLevel level)
+{
+	CommandPool& commandPool = m_commandPools[std::make_pair(queueFamilyIndex, level)];
+	if (commandPool.commandPool == VK_NULL_HANDLE)
+	{
+		VkCommandPoolCreateInfo commandPoolInfo = {};
+		commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		commandPoolInfo.queueFamilyIndex = queueFamilyIndex;
+		commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		if (vkCreateCommandPool(m_device, &commandPoolInfo, nullptr, &commandPool.commandPool) != VK_SUCCESS)
+		{
+			m_commandPools.erase(std::make_pair(queueFamilyIndex, level));
+			throw std::runtime_error("failed to create command pool");
+		}
+	}
+	return commandPool;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "Headers.h"
+#include <vulkan/vulkan.h>
+#include <map>
+#include <mutex>
+
+// Recycles the small objects a renderer keeps making: fences, semaphores, query pools and command buffers.
+// Released objects are reset and kept for the next acquire instead of being destroyed, so steady-state frames
+// don't call into the driver to create anything. Everything ever created is destroyed with the pools, handed
+// out or not, so long-lived users need not give their objects back
+class DevicePools
+{
+public:
+	DevicePools() = default;
+	~DevicePools();
+
+	DevicePools(const DevicePools&) = delete;
+	DevicePools& operator=(const DevicePools&) = delete;
+
+	void init(VkDevice device);
+	// The device must be idle
+	void destroy();
+
+	VkFence acquireFence(bool signaled = false);
+	// The fence must not be pending anymore, it comes back unsignalled
+	void releaseFence(VkFence fence);
+
+	VkSemaphore acquireSemaphore();
+	// No submission may still signal or wait on it
+	void releaseSemaphore(VkSemaphore semaphore);
+
+	// Recycled or not, queries have to be reset with vkCmdResetQueryPool before they are used
+	VkQueryPool acquireQueryPool(VkQueryType type, uint32_t queryCount, VkQueryPipelineStatisticFlags pipelineStatistics = 0);
+	void releaseQueryPool(VkQueryPool queryPool);
+
+	// Buffers come from one command pool per queue family and level, so only one thread at a time may record
+	// into the buffers of a family
+	VkCommandBuffer acquireCommandBuffer(uint32_t queueFamilyIndex, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	void acquireCommandBuffers(uint32_t queueFamilyIndex, VkCommandBufferLevel level, uint32_t count, VkCommandBuffer* commandBuffers);
+	// Their last submission must be complete; they are reset here and come back in the initial state
+	void releaseCommandBuffers(uint32_t queueFamilyIndex, VkCommandBufferLevel level, uint32_t count, const VkCommandBuffer* commandBuffers);
+
+	// Objects made through the driver so far, everything else was a recycled one
+	uint64_t getCreatedCount() const { return m_createdCount; }
+
+private:
+	struct QueryPoolKey
+	{
+		VkQueryType type;
+		uint32_t queryCount;
+		VkQueryPipelineStatisticFlags pipelineStatistics;
+
+		bool operator<(const QueryPoolKey& rhs) const
+		{
+			if (type != rhs.type) return type < rhs.type;
+			if (queryCount != rhs.queryCount) return queryCount < rhs.queryCount;
+			return pipelineStatistics < rhs.pipelineStatistics;
+		}
+	};
+
+	struct QueryPools
+	{
+		std::vector<VkQueryPool> all;
+		std::vector<VkQueryPool> free;
+	};
+
+	struct CommandPool
+	{
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> free;
+	};
+
+	CommandPool& getCommandPool(uint32_t queueFamilyIndex, VkCommandBufferLevel level);
+
+	VkDevice m_device = VK_NULL_HANDLE;
+
+	std::vector<VkFence> m_fences;
+	std::vector<VkFence> m_freeFences;
+	std::vector<VkSemaphore> m_semaphores;
+	std::vector<VkSemaphore> m_freeSemaphores;
+	std::map<QueryPoolKey, QueryPools> m_queryPools;
+	std::map<VkQueryPool, QueryPoolKey> m_queryPoolKeys;
+	std::map<std::pair<uint32_t, VkCommandBufferLevel>, CommandPool> m_commandPools;
+
+	uint64_t m_createdCount = 0;
+
+	std::mutex m_mutex;
+};
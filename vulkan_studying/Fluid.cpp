@@ -1,23 +1,128 @@
 #include "Fluid.h"
+#include "FluidSolver.h"
+#include "FluidRecorder.h"
+#include "FluidPlayer.h"
+#include "FluidStatsLog.h"
+#include "FluidMeshCollider.h"
+#include "FluidFrameRing.h"
 
+#include <atomic>
 
-Fluid::Fluid()
+
+Fluid::Fluid() :
+m_solver(FluidSolver::create(3, FluidKernelType::Poly6Spiky, FluidPrecision::Single))
 {
-	static uint16_t id = 0;
+	static std::atomic<uint32_t> id(0);
 	m_fluidIndex = id++;
 }
 
 
-Fluid::Fluid(FluidParticle fluidParticle, FluidParams fluidParams) : 
+Fluid::Fluid(FluidParticle fluidParticle, FluidParams fluidParams) :
 m_fluidParticle(fluidParticle),
-m_fluidParams(fluidParams)
+m_fluidParams(fluidParams),
+m_solver(FluidSolver::create(3, FluidKernelType::Poly6Spiky, FluidPrecision::Single))
 {
-	static uint16_t id = 0;
+	// Sweep runs construct fluids from several threads
+	static std::atomic<uint32_t> id(0);
 	m_fluidIndex = id++;
 	m_fluidParticle.fluidIndex = m_fluidIndex;
 	m_fluidParams.fluidIndex = m_fluidIndex;
+
+	spawnParticles();
 }
 
 Fluid::~Fluid()
 {
 }
+
+void Fluid::draw()
+{
+}
+
+void Fluid::update()
+{
+	if (m_player != nullptr)
+	{
+		// Playback drives the particles straight from disk, the solver stays idle
+		m_player->nextFrame(m_particles);
+		return;
+	}
+	if (m_subscriber != nullptr)
+	{
+		m_subscriber->readLatest(m_particles);
+		return;
+	}
+
+	m_solver->step(m_particles, m_fluidParams);
+	if (m_collider != nullptr && m_collider->collide(m_particles, m_fluidParams) > 0)
+	{
+		m_solver->reloadParticles();
+	}
+
+	if (m_recorder != nullptr)
+	{
+		m_recorder->push(m_particles);
+	}
+	if (m_publisher != nullptr)
+	{
+		m_publisher->publish(m_particles);
+	}
+	if (m_statsLog != nullptr)
+	{
+		m_statsLog->write(m_solver->getStats());
+	}
+}
+
+void Fluid::attachPlayer(FluidPlayer* player)
+{
+	m_player = player;
+	m_solver->invalidate();
+}
+
+void Fluid::attachSubscriber(FluidFrameRing* subscriber)
+{
+	m_subscriber = subscriber;
+	m_solver->invalidate();
+}
+
+void Fluid::attachStatsLog(FluidStatsLog* statsLog)
+{
+	m_statsLog = statsLog;
+	if (statsLog != nullptr)
+	{
+		m_solver->setStatsEnabled(true);
+	}
+}
+
+void Fluid::createSolver(uint32_t dimensions, FluidKernelType kernelType, FluidPrecision precision)
+{
+	std::unique_ptr<FluidSolver> solver = FluidSolver::create(dimensions, kernelType, precision);
+	solver->copySettings(*m_solver);
+	m_solver = std::move(solver);
+}
+
+void Fluid::createHybridSolver(FluidHybridTransfer transfer)
+{
+	std::unique_ptr<FluidSolver> solver = FluidSolver::createHybrid(transfer);
+	solver->copySettings(*m_solver);
+	m_solver = std::move(solver);
+}
+
+void Fluid::spawnParticles()
+{
+	// Particles start as a cube lattice with the template particle in the corner
+	const uint64_t count = m_fluidParams.particlesCount;
+	const uint64_t side = static_cast<uint64_t>(std::ceil(std::cbrt(static_cast<double>(count))));
+	const float spacing = 2.0f * m_fluidParams.particleRadius;
+
+	m_particles.resize(count, m_fluidParticle);
+
+	for (uint64_t i = 0; i < count; i++)
+	{
+		glm::vec3 offset(
+			static_cast<float>(i % side),
+			static_cast<float>((i / side) % side),
+			static_cast<float>(i / (side * side)));
+		m_particles[i].position = m_fluidParticle.position + offset * spacing;
+	}
+}
@@ -2,33 +2,65 @@
 #include "Entity.h"
 #include "Cleaner.h"
 #include <vulkan/vulkan.h>
+#include "FluidKernels.h"
+#include "GpuLayout.h"
+#include <memory>
 
-//SSBO struct
+class FluidSolver;
+class FluidRecorder;
+class FluidPlayer;
+class FluidStatsLog;
+class FluidMeshCollider;
+class FluidFrameRing;
+
+//SSBO struct, std430; vec3s are followed by a scalar so none of them leaves padding behind
 struct FluidParticle
 {
 	glm::vec3 position;
-	glm::vec3 velocity;
-	glm::vec3 force;
 	float density;
+	glm::vec3 velocity;
 	float pressure;
-	uint16_t fluidIndex = 0;//overwrites in Fluid constructor
+	glm::vec3 force;
+	uint32_t fluidIndex = 0;//overwrites in Fluid constructor
 };
 
-//UBO struct
+typedef GpuStructLayout<GpuLayoutRule::Std430, glm::vec3, float, glm::vec3, float, glm::vec3, uint32_t> FluidParticleLayout;
+GPU_LAYOUT_CHECK_MEMBER(FluidParticle, FluidParticleLayout, 0, position);
+GPU_LAYOUT_CHECK_MEMBER(FluidParticle, FluidParticleLayout, 1, density);
+GPU_LAYOUT_CHECK_MEMBER(FluidParticle, FluidParticleLayout, 2, velocity);
+GPU_LAYOUT_CHECK_MEMBER(FluidParticle, FluidParticleLayout, 3, pressure);
+GPU_LAYOUT_CHECK_MEMBER(FluidParticle, FluidParticleLayout, 4, force);
+GPU_LAYOUT_CHECK_MEMBER(FluidParticle, FluidParticleLayout, 5, fluidIndex);
+GPU_LAYOUT_CHECK_SIZE(FluidParticle, FluidParticleLayout);
+
+//UBO struct, std140; counts are 32 bit since GLSL has no 64 or 16 bit integers without extensions
 struct FluidParams
 {
-	uint64_t particlesCount;
+	glm::vec3 force;
+	float timeStep;
+	uint32_t particlesCount;
 	float particleRadius;
 	float particleMass;
 	float particleRestingDensity;
 	float particleStiffness;
 	float particleViscosity;
 	float smoothingLength;
-	glm::vec3 force;
-	float timeStep;
-	uint16_t fluidIndex = 0;//overwrites in Fluid constructor
+	uint32_t fluidIndex = 0;//overwrites in Fluid constructor
 };
 
+typedef GpuStructLayout<GpuLayoutRule::Std140, glm::vec3, float, uint32_t, float, float, float, float, float, float, uint32_t> FluidParamsLayout;
+GPU_LAYOUT_CHECK_MEMBER(FluidParams, FluidParamsLayout, 0, force);
+GPU_LAYOUT_CHECK_MEMBER(FluidParams, FluidParamsLayout, 1, timeStep);
+GPU_LAYOUT_CHECK_MEMBER(FluidParams, FluidParamsLayout, 2, particlesCount);
+GPU_LAYOUT_CHECK_MEMBER(FluidParams, FluidParamsLayout, 3, particleRadius);
+GPU_LAYOUT_CHECK_MEMBER(FluidParams, FluidParamsLayout, 4, particleMass);
+GPU_LAYOUT_CHECK_MEMBER(FluidParams, FluidParamsLayout, 5, particleRestingDensity);
+GPU_LAYOUT_CHECK_MEMBER(FluidParams, FluidParamsLayout, 6, particleStiffness);
+GPU_LAYOUT_CHECK_MEMBER(FluidParams, FluidParamsLayout, 7, particleViscosity);
+GPU_LAYOUT_CHECK_MEMBER(FluidParams, FluidParamsLayout, 8, smoothingLength);
+GPU_LAYOUT_CHECK_MEMBER(FluidParams, FluidParamsLayout, 9, fluidIndex);
+GPU_LAYOUT_CHECK_SIZE(FluidParams, FluidParamsLayout);
+
 class Fluid :
 	public Entity
 {
@@ -36,10 +68,46 @@ public:
 	Fluid();
 	Fluid(FluidParticle, FluidParams);
 	~Fluid();
+
+	void draw() override;
+	void update() override;
+
+	// Recorder receives every simulated frame, player replaces the solver while attached
+	void attachRecorder(FluidRecorder* recorder) { m_recorder = recorder; }
+	void attachPlayer(FluidPlayer* player);
+	// Log receives the solver stats of every simulated step, attaching one turns stats on
+	void attachStatsLog(FluidStatsLog* statsLog);
+	// Collider pushes particles out of its meshes after every step; its owner updates it when the meshes move
+	void attachCollider(FluidMeshCollider* collider) { m_collider = collider; }
+	// Publisher receives every simulated frame for other processes; a subscriber replaces the solver like a player,
+	// taking the newest frame another process published and keeping the current one when nothing new arrived
+	void attachPublisher(FluidFrameRing* publisher) { m_publisher = publisher; }
+	void attachSubscriber(FluidFrameRing* subscriber);
+
+	// Replaces the solver with one specialised for the given dimension, kernel and precision, keeping its settings
+	void createSolver(uint32_t dimensions, FluidKernelType kernelType, FluidPrecision precision);
+	// Replaces the solver with the FLIP/APIC grid solver, same particles and rendering
+	void createHybridSolver(FluidHybridTransfer transfer);
+
+	std::vector<FluidParticle>& getParticles() { return m_particles; }
+	FluidParams& getParams() { return m_fluidParams; }
+	FluidSolver& getSolver() { return *m_solver; }
+
 private:
+	void spawnParticles();
+
 	 FluidParticle m_fluidParticle;
 	 FluidParams m_fluidParams;
 
-	uint16_t m_fluidIndex;
-};
+	uint32_t m_fluidIndex;
 
+	std::vector<FluidParticle> m_particles;
+	std::unique_ptr<FluidSolver> m_solver;
+
+	FluidRecorder* m_recorder = nullptr;
+	FluidPlayer* m_player = nullptr;
+	FluidStatsLog* m_statsLog = nullptr;
+	FluidMeshCollider* m_collider = nullptr;
+	FluidFrameRing* m_publisher = nullptr;
+	FluidFrameRing* m_subscriber = nullptr;
+};
@@ -0,0 +1,670 @@
+#include "FluidFlipSolver.h"
+
+#include <glm/gtc/matrix_access.hpp>
+
+namespace
+{
+	// Air faces filled per sub-step; particles move less than a cell per sub-step and sample two faces around them
+	const uint8_t extrapolationLayers = 3;
+	// Marks faces touching a solid cell, which are neither extrapolated into nor from
+	const uint8_t solidFace = 0xff;
+}
+
+FluidFlipSolver::FluidFlipSolver(FluidHybridTransfer transfer) :
+	m_transfer(transfer)
+{
+}
+
+void FluidFlipSolver::setDomain(const glm::vec3& minimum, const glm::vec3& maximum)
+{
+	m_domainMinimum = minimum;
+	m_domainMaximum = maximum;
+	m_domainSet = true;
+	m_cellSize = 0.0f;
+}
+
+void FluidFlipSolver::setPressureSolver(float tolerance, uint32_t maxIterations)
+{
+	m_pressureTolerance = tolerance;
+	m_maxPressureIterations = std::max(maxIterations, 1u);
+}
+
+void FluidFlipSolver::invalidate()
+{
+	m_affine.clear();
+}
+
+size_t FluidFlipSolver::getGridMemoryUsage() const
+{
+	size_t bytes = 0;
+	for (const auto& field : m_faces)
+	{
+		bytes += (field.values.capacity() + field.weights.capacity() + field.previous.capacity()) * sizeof(float);
+		bytes += field.known.capacity() * sizeof(uint8_t);
+	}
+	bytes += m_cellTypes.capacity() * sizeof(uint8_t);
+	bytes += (m_cellParticles.capacity() + m_liquidCells.capacity()) * sizeof(uint32_t);
+	bytes += (m_pressure.capacity() + m_residual.capacity() + m_search.capacity() +
+		m_preconditioned.capacity() + m_product.capacity()) * sizeof(double);
+	return bytes;
+}
+
+void FluidFlipSolver::step(std::vector<FluidParticle>& particles, const FluidParams& params)
+{
+	FluidPhaseTimer stepTimer;
+	FluidPhaseTimer timer;
+	uint64_t stepIndex = m_stats.step + 1;
+	m_stats = FluidSolverStats();
+	m_stats.step = stepIndex;
+
+	if (particles.empty()) return;
+
+	setupGrid(particles, params);
+	if (m_affine.size() != particles.size())
+	{
+		m_affine.assign(particles.size(), glm::mat3(0.0f));
+	}
+	m_startVelocities.resize(particles.size());
+	for (size_t p = 0; p < particles.size(); p++)
+	{
+		m_startVelocities[p] = particles[p].velocity;
+	}
+
+	// Sub-steps keep particles within courantFactor cells per transfer
+	float maxSpeed = 0.0f;
+	for (const auto& particle : particles)
+	{
+		maxSpeed = std::max(maxSpeed, glm::length(particle.velocity));
+	}
+	const uint32_t maxSubSteps = 32;
+	uint32_t subSteps = 1;
+	if (maxSpeed > 0.0f)
+	{
+		float cells = maxSpeed * params.timeStep * m_inverseCellSize / m_courantFactor;
+		subSteps = static_cast<uint32_t>(std::min(std::ceil(cells), static_cast<float>(maxSubSteps)));
+		subSteps = std::max(subSteps, 1u);
+	}
+	const float timeStep = params.timeStep / subSteps;
+	m_stats.integrateSeconds += timer.lap();
+
+	for (uint32_t subStep = 0; subStep < subSteps; subStep++)
+	{
+		transferToGrid(particles);
+		markCells(particles);
+		m_stats.transferSeconds += timer.lap();
+
+		applyBodyForce(params.force, timeStep);
+		enforceBoundaries();
+		m_stats.forceSeconds += timer.lap();
+
+		m_stats.pressureIterations += project();
+		extrapolateVelocity();
+		m_stats.pressureSeconds += timer.lap();
+
+		transferToParticles(particles);
+		m_stats.transferSeconds += timer.lap();
+
+		advect(particles, timeStep);
+		m_stats.integrateSeconds += timer.lap();
+		m_stats.particleUpdates += particles.size();
+	}
+
+	storeParticleFields(particles, params, timeStep);
+	m_stats.integrateSeconds += timer.lap();
+	m_stats.totalSeconds = stepTimer.lap();
+}
+
+void FluidFlipSolver::setupGrid(const std::vector<FluidParticle>& particles, const FluidParams& params)
+{
+	const float cellSize = 4.0f * params.particleRadius;
+	if (cellSize == m_cellSize) return;
+
+	if (!m_domainSet)
+	{
+		glm::vec3 minimum(std::numeric_limits<float>::max());
+		glm::vec3 maximum(std::numeric_limits<float>::lowest());
+		for (const auto& particle : particles)
+		{
+			minimum = glm::min(minimum, particle.position);
+			maximum = glm::max(maximum, particle.position);
+		}
+		glm::vec3 margin = glm::max((maximum - minimum) * 0.5f, glm::vec3(2.0f * cellSize));
+		m_domainMinimum = minimum - margin;
+		m_domainMaximum = maximum + margin;
+		m_domainSet = true;
+	}
+
+	m_cellSize = cellSize;
+	m_inverseCellSize = 1.0f / cellSize;
+
+	// One layer of solid cells outside the domain on every side
+	m_origin = m_domainMinimum - glm::vec3(cellSize);
+	m_dimensions = glm::ivec3(glm::ceil((m_domainMaximum - m_domainMinimum) * m_inverseCellSize)) + 2;
+	m_dimensions = glm::max(m_dimensions, glm::ivec3(3));
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		FaceField& field = m_faces[axis];
+		field.size = m_dimensions;
+		field.size[axis]++;
+		field.offset = glm::vec3(0.5f);
+		field.offset[axis] = 0.0f;
+
+		size_t facesCount = static_cast<size_t>(field.size.x) * field.size.y * field.size.z;
+		field.values.assign(facesCount, 0.0f);
+		field.weights.assign(facesCount, 0.0f);
+		field.previous.assign(facesCount, 0.0f);
+		field.known.assign(facesCount, 0);
+	}
+
+	size_t cellsCount = static_cast<size_t>(m_dimensions.x) * m_dimensions.y * m_dimensions.z;
+	m_cellTypes.assign(cellsCount, Air);
+	m_cellParticles.assign(cellsCount, 0);
+	m_pressure.assign(cellsCount, 0.0);
+	m_residual.assign(cellsCount, 0.0);
+	m_search.assign(cellsCount, 0.0);
+	m_preconditioned.assign(cellsCount, 0.0);
+	m_product.assign(cellsCount, 0.0);
+}
+
+FluidFlipSolver::Stencil FluidFlipSolver::getStencil(const FaceField& field, const glm::vec3& position) const
+{
+	glm::vec3 local = position - field.offset;
+	Stencil stencil;
+	stencil.base = glm::clamp(glm::ivec3(glm::floor(local)), glm::ivec3(0), field.size - 2);
+	stencil.fraction = glm::clamp(local - glm::vec3(stencil.base), glm::vec3(0.0f), glm::vec3(1.0f));
+	return stencil;
+}
+
+void FluidFlipSolver::transferToGrid(const std::vector<FluidParticle>& particles)
+{
+	const bool apic = m_transfer == FluidHybridTransfer::Apic;
+
+	for (auto& field : m_faces)
+	{
+		std::fill(field.values.begin(), field.values.end(), 0.0f);
+		std::fill(field.weights.begin(), field.weights.end(), 0.0f);
+	}
+
+	for (size_t p = 0; p < particles.size(); p++)
+	{
+		const glm::vec3 position = toGrid(particles[p].position);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			FaceField& field = m_faces[axis];
+			Stencil stencil = getStencil(field, position);
+
+			for (int k = 0; k < 2; k++)
+			{
+				for (int j = 0; j < 2; j++)
+				{
+					for (int i = 0; i < 2; i++)
+					{
+						float weight =
+							(i ? stencil.fraction.x : 1.0f - stencil.fraction.x) *
+							(j ? stencil.fraction.y : 1.0f - stencil.fraction.y) *
+							(k ? stencil.fraction.z : 1.0f - stencil.fraction.z);
+						if (weight == 0.0f) continue;
+
+						float value = particles[p].velocity[axis];
+						if (apic)
+						{
+							// Affine part: the particle's velocity gradient applied to the offset to this face
+							glm::vec3 face = glm::vec3(stencil.base + glm::ivec3(i, j, k)) + field.offset;
+							glm::vec3 offset = (face - position) * m_cellSize;
+							value += glm::dot(glm::row(m_affine[p], axis), offset);
+						}
+
+						size_t index = field.index(stencil.base.x + i, stencil.base.y + j, stencil.base.z + k);
+						field.values[index] += weight * value;
+						field.weights[index] += weight;
+					}
+				}
+			}
+		}
+	}
+
+	for (auto& field : m_faces)
+	{
+		for (size_t i = 0; i < field.values.size(); i++)
+		{
+			field.values[i] = field.weights[i] > 0.0f ? field.values[i] / field.weights[i] : 0.0f;
+		}
+		field.previous = field.values;
+	}
+}
+
+void FluidFlipSolver::markCells(const std::vector<FluidParticle>& particles)
+{
+	std::fill(m_cellParticles.begin(), m_cellParticles.end(), 0u);
+	for (const auto& particle : particles)
+	{
+		glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor(toGrid(particle.position))), glm::ivec3(0), m_dimensions - 1);
+		m_cellParticles[getCellIndex(cell.x, cell.y, cell.z)]++;
+	}
+
+	m_liquidCells.clear();
+	for (int k = 0; k < m_dimensions.z; k++)
+	{
+		for (int j = 0; j < m_dimensions.y; j++)
+		{
+			for (int i = 0; i < m_dimensions.x; i++)
+			{
+				size_t cell = getCellIndex(i, j, k);
+				bool border = i == 0 || j == 0 || k == 0 || i == m_dimensions.x - 1 || j == m_dimensions.y - 1 || k == m_dimensions.z - 1;
+				if (border)
+				{
+					m_cellTypes[cell] = Solid;
+				}
+				else if (m_cellParticles[cell] != 0)
+				{
+					m_cellTypes[cell] = Liquid;
+					m_liquidCells.push_back(static_cast<uint32_t>(cell));
+				}
+				else
+				{
+					m_cellTypes[cell] = Air;
+				}
+			}
+		}
+	}
+}
+
+void FluidFlipSolver::applyBodyForce(const glm::vec3& acceleration, float timeStep)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (acceleration[axis] == 0.0f) continue;
+
+		for (auto& value : m_faces[axis].values)
+		{
+			value += acceleration[axis] * timeStep;
+		}
+	}
+}
+
+void FluidFlipSolver::enforceBoundaries()
+{
+	// A face touching a solid cell carries no flow through it
+	for (int axis = 0; axis < 3; axis++)
+	{
+		FaceField& field = m_faces[axis];
+		for (int k = 0; k < field.size.z; k++)
+		{
+			for (int j = 0; j < field.size.y; j++)
+			{
+				for (int i = 0; i < field.size.x; i++)
+				{
+					glm::ivec3 after(i, j, k);
+					glm::ivec3 before = after;
+					before[axis]--;
+
+					bool solid = before[axis] < 0 || after[axis] >= m_dimensions[axis] ||
+						m_cellTypes[getCellIndex(before.x, before.y, before.z)] == Solid ||
+						m_cellTypes[getCellIndex(after.x, after.y, after.z)] == Solid;
+					if (solid)
+					{
+						field.values[field.index(i, j, k)] = 0.0f;
+					}
+				}
+			}
+		}
+	}
+}
+
+// Applies the pressure Poisson matrix over liquid cells: non solid neighbours on the diagonal,
+// -1 per liquid neighbour; air neighbours hold zero pressure and solid ones no gradient
+void FluidFlipSolver::applyPressureMatrix(const std::vector<double>& input, std::vector<double>& output) const
+{
+	const size_t strides[3] = { 1, static_cast<size_t>(m_dimensions.x), static_cast<size_t>(m_dimensions.x) * m_dimensions.y };
+
+	for (uint32_t cell : m_liquidCells)
+	{
+		double diagonal = 0.0;
+		double sum = 0.0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			for (size_t neighbour : { cell - strides[axis], cell + strides[axis] })
+			{
+				uint8_t type = m_cellTypes[neighbour];
+				if (type == Solid) continue;
+
+				diagonal += 1.0;
+				if (type == Liquid)
+				{
+					sum += input[neighbour];
+				}
+			}
+		}
+		output[cell] = diagonal * input[cell] - sum;
+	}
+}
+
+uint32_t FluidFlipSolver::project()
+{
+	const size_t strides[3] = { 1, static_cast<size_t>(m_dimensions.x), static_cast<size_t>(m_dimensions.x) * m_dimensions.y };
+
+	// Right hand side -div(u) * dx^2, in units of the scaled pressure phi = p * dt / rho
+	double maxResidual = 0.0;
+	for (uint32_t cell : m_liquidCells)
+	{
+		int i = static_cast<int>(cell % m_dimensions.x);
+		int j = static_cast<int>((cell / m_dimensions.x) % m_dimensions.y);
+		int k = static_cast<int>(cell / (static_cast<size_t>(m_dimensions.x) * m_dimensions.y));
+
+		double divergence =
+			m_faces[0].values[m_faces[0].index(i + 1, j, k)] - m_faces[0].values[m_faces[0].index(i, j, k)] +
+			m_faces[1].values[m_faces[1].index(i, j + 1, k)] - m_faces[1].values[m_faces[1].index(i, j, k)] +
+			m_faces[2].values[m_faces[2].index(i, j, k + 1)] - m_faces[2].values[m_faces[2].index(i, j, k)];
+
+		m_pressure[cell] = 0.0;
+		m_residual[cell] = -divergence * m_cellSize;
+		maxResidual = std::max(maxResidual, std::abs(m_residual[cell]));
+	}
+
+	// Jacobi preconditioner: the diagonal is the number of non solid neighbours
+	auto precondition = [&]()
+	{
+		double sigma = 0.0;
+		for (uint32_t cell : m_liquidCells)
+		{
+			double diagonal = 0.0;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				diagonal += m_cellTypes[cell - strides[axis]] != Solid;
+				diagonal += m_cellTypes[cell + strides[axis]] != Solid;
+			}
+			m_preconditioned[cell] = m_residual[cell] / diagonal;
+			sigma += m_preconditioned[cell] * m_residual[cell];
+		}
+		return sigma;
+	};
+
+	uint32_t iterations = 0;
+	const double tolerance = m_pressureTolerance * maxResidual;
+	if (maxResidual > 0.0)
+	{
+		double sigma = precondition();
+		for (uint32_t cell : m_liquidCells)
+		{
+			m_search[cell] = m_preconditioned[cell];
+		}
+
+		while (iterations < m_maxPressureIterations)
+		{
+			iterations++;
+			applyPressureMatrix(m_search, m_product);
+
+			double curvature = 0.0;
+			for (uint32_t cell : m_liquidCells)
+			{
+				curvature += m_search[cell] * m_product[cell];
+			}
+			if (curvature <= 0.0) break;
+
+			double alpha = sigma / curvature;
+			maxResidual = 0.0;
+			for (uint32_t cell : m_liquidCells)
+			{
+				m_pressure[cell] += alpha * m_search[cell];
+				m_residual[cell] -= alpha * m_product[cell];
+				maxResidual = std::max(maxResidual, std::abs(m_residual[cell]));
+			}
+			if (maxResidual <= tolerance) break;
+
+			double sigmaNew = precondition();
+			double beta = sigmaNew / sigma;
+			for (uint32_t cell : m_liquidCells)
+			{
+				m_search[cell] = m_preconditioned[cell] + beta * m_search[cell];
+			}
+			sigma = sigmaNew;
+		}
+	}
+
+	// Subtract the pressure gradient from every face between two non solid cells with liquid on a side
+	for (int axis = 0; axis < 3; axis++)
+	{
+		FaceField& field = m_faces[axis];
+		for (int k = 0; k < field.size.z; k++)
+		{
+			for (int j = 0; j < field.size.y; j++)
+			{
+				for (int i = 0; i < field.size.x; i++)
+				{
+					glm::ivec3 after(i, j, k);
+					if (after[axis] == 0 || after[axis] >= m_dimensions[axis]) continue;
+					glm::ivec3 before = after;
+					before[axis]--;
+
+					size_t beforeCell = getCellIndex(before.x, before.y, before.z);
+					size_t afterCell = getCellIndex(after.x, after.y, after.z);
+					uint8_t beforeType = m_cellTypes[beforeCell];
+					uint8_t afterType = m_cellTypes[afterCell];
+					if (beforeType == Solid || afterType == Solid) continue;
+					if (beforeType != Liquid && afterType != Liquid) continue;
+
+					double beforePressure = beforeType == Liquid ? m_pressure[beforeCell] : 0.0;
+					double afterPressure = afterType == Liquid ? m_pressure[afterCell] : 0.0;
+					field.values[field.index(i, j, k)] -= static_cast<float>((afterPressure - beforePressure) * m_inverseCellSize);
+				}
+			}
+		}
+	}
+
+	return iterations;
+}
+
+void FluidFlipSolver::extrapolateVelocity()
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		FaceField& field = m_faces[axis];
+
+		// Layer 1 is what the projection set: faces between two non solid cells with liquid on a side
+		for (int k = 0; k < field.size.z; k++)
+		{
+			for (int j = 0; j < field.size.y; j++)
+			{
+				for (int i = 0; i < field.size.x; i++)
+				{
+					glm::ivec3 after(i, j, k);
+					glm::ivec3 before = after;
+					before[axis]--;
+
+					uint8_t known = solidFace;
+					if (before[axis] >= 0 && after[axis] < m_dimensions[axis])
+					{
+						uint8_t beforeType = m_cellTypes[getCellIndex(before.x, before.y, before.z)];
+						uint8_t afterType = m_cellTypes[getCellIndex(after.x, after.y, after.z)];
+						if (beforeType != Solid && afterType != Solid)
+						{
+							known = beforeType == Liquid || afterType == Liquid ? 1 : 0;
+						}
+					}
+					field.known[field.index(i, j, k)] = known;
+				}
+			}
+		}
+
+		// Every further layer averages the known faces around each unknown one, faces filled in this layer only
+		// count from the next one on
+		const size_t strides[3] = { 1, static_cast<size_t>(field.size.x), static_cast<size_t>(field.size.x) * field.size.y };
+		for (uint8_t layer = 1; layer <= extrapolationLayers; layer++)
+		{
+			for (int k = 1; k < field.size.z - 1; k++)
+			{
+				for (int j = 1; j < field.size.y - 1; j++)
+				{
+					for (int i = 1; i < field.size.x - 1; i++)
+					{
+						size_t face = field.index(i, j, k);
+						if (field.known[face] != 0) continue;
+
+						float sum = 0.0f;
+						uint32_t count = 0;
+						for (int neighbourAxis = 0; neighbourAxis < 3; neighbourAxis++)
+						{
+							for (size_t neighbour : { face - strides[neighbourAxis], face + strides[neighbourAxis] })
+							{
+								uint8_t known = field.known[neighbour];
+								if (known != 0 && known <= layer)
+								{
+									sum += field.values[neighbour];
+									count++;
+								}
+							}
+						}
+						if (count != 0)
+						{
+							field.values[face] = sum / count;
+							field.known[face] = layer + 1;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void FluidFlipSolver::transferToParticles(std::vector<FluidParticle>& particles)
+{
+	const bool apic = m_transfer == FluidHybridTransfer::Apic;
+
+	for (size_t p = 0; p < particles.size(); p++)
+	{
+		const glm::vec3 position = toGrid(particles[p].position);
+		glm::vec3 picVelocity(0.0f);
+		glm::vec3 previousVelocity(0.0f);
+		glm::mat3 affine(0.0f);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const FaceField& field = m_faces[axis];
+			Stencil stencil = getStencil(field, position);
+			glm::vec3 gradient(0.0f);
+
+			for (int k = 0; k < 2; k++)
+			{
+				for (int j = 0; j < 2; j++)
+				{
+					for (int i = 0; i < 2; i++)
+					{
+						glm::vec3 weights(
+							i ? stencil.fraction.x : 1.0f - stencil.fraction.x,
+							j ? stencil.fraction.y : 1.0f - stencil.fraction.y,
+							k ? stencil.fraction.z : 1.0f - stencil.fraction.z);
+						glm::vec3 slopes(i ? 1.0f : -1.0f, j ? 1.0f : -1.0f, k ? 1.0f : -1.0f);
+
+						size_t index = field.index(stencil.base.x + i, stencil.base.y + j, stencil.base.z + k);
+						float value = field.values[index];
+						float weight = weights.x * weights.y * weights.z;
+
+						picVelocity[axis] += weight * value;
+						previousVelocity[axis] += weight * field.previous[index];
+						gradient += value * glm::vec3(
+							slopes.x * weights.y * weights.z,
+							weights.x * slopes.y * weights.z,
+							weights.x * weights.y * slopes.z);
+					}
+				}
+			}
+
+			// glm matrices are column major, row axis holds the gradient of velocity component axis
+			for (int column = 0; column < 3; column++)
+			{
+				affine[column][axis] = gradient[column] * m_inverseCellSize;
+			}
+		}
+
+		if (apic)
+		{
+			particles[p].velocity = picVelocity;
+			m_affine[p] = affine;
+		}
+		else
+		{
+			glm::vec3 flipVelocity = particles[p].velocity + picVelocity - previousVelocity;
+			particles[p].velocity = m_flipRatio * flipVelocity + (1.0f - m_flipRatio) * picVelocity;
+		}
+	}
+}
+
+glm::vec3 FluidFlipSolver::sampleVelocity(const glm::vec3& position) const
+{
+	const glm::vec3 local = toGrid(position);
+	glm::vec3 velocity(0.0f);
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const FaceField& field = m_faces[axis];
+		Stencil stencil = getStencil(field, local);
+		const glm::vec3& f = stencil.fraction;
+		const glm::ivec3& b = stencil.base;
+
+		velocity[axis] =
+			(1 - f.z) * ((1 - f.y) * ((1 - f.x) * field.values[field.index(b.x, b.y, b.z)] + f.x * field.values[field.index(b.x + 1, b.y, b.z)]) +
+				f.y * ((1 - f.x) * field.values[field.index(b.x, b.y + 1, b.z)] + f.x * field.values[field.index(b.x + 1, b.y + 1, b.z)])) +
+			f.z * ((1 - f.y) * ((1 - f.x) * field.values[field.index(b.x, b.y, b.z + 1)] + f.x * field.values[field.index(b.x + 1, b.y, b.z + 1)]) +
+				f.y * ((1 - f.x) * field.values[field.index(b.x, b.y + 1, b.z + 1)] + f.x * field.values[field.index(b.x + 1, b.y + 1, b.z + 1)]));
+	}
+	return velocity;
+}
+
+void FluidFlipSolver::advect(std::vector<FluidParticle>& particles, float timeStep)
+{
+	// Keep particles out of the solid border cells
+	const float epsilon = 1e-3f * m_cellSize;
+	const glm::vec3 minimum = m_origin + glm::vec3(m_cellSize + epsilon);
+	const glm::vec3 maximum = m_origin + glm::vec3(m_dimensions - 1) * m_cellSize - glm::vec3(epsilon);
+
+	// Midpoint rule through the divergence free grid velocity
+	for (auto& particle : particles)
+	{
+		glm::vec3 middle = particle.position + 0.5f * timeStep * sampleVelocity(particle.position);
+		particle.position = glm::clamp(particle.position + timeStep * sampleVelocity(middle), minimum, maximum);
+	}
+}
+
+void FluidFlipSolver::storeParticleFields(std::vector<FluidParticle>& particles, const FluidParams& params, float subTimeStep)
+{
+	// Density from the cell occupancy, eight particles per cell being rest density; pressure from the last solve
+	const float particlesPerCell = 8.0f;
+	const double pressureScale = params.particleRestingDensity / subTimeStep;
+
+	double densityError = 0.0;
+	for (size_t p = 0; p < particles.size(); p++)
+	{
+		FluidParticle& particle = particles[p];
+		glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor(toGrid(particle.position))), glm::ivec3(0), m_dimensions - 1);
+		size_t index = getCellIndex(cell.x, cell.y, cell.z);
+
+		particle.density = params.particleRestingDensity * m_cellParticles[index] / particlesPerCell;
+		particle.pressure = m_cellTypes[index] == Liquid ? static_cast<float>(m_pressure[index] * pressureScale) : 0.0f;
+		particle.force = (particle.velocity - m_startVelocities[p]) / params.timeStep * particle.density;
+
+		if (m_statsEnabled)
+		{
+			float error = std::abs(particle.density - params.particleRestingDensity) / params.particleRestingDensity;
+			m_stats.maxDensityError = std::max(m_stats.maxDensityError, error);
+			densityError += error;
+		}
+	}
+
+	if (m_statsEnabled)
+	{
+		m_stats.meanDensityError = static_cast<float>(densityError / particles.size());
+		m_stats.cellsCount = m_cellTypes.size();
+		m_stats.occupiedCellsCount = m_liquidCells.size();
+		for (uint32_t cell : m_liquidCells)
+		{
+			m_stats.maxParticlesPerCell = std::max(m_stats.maxParticlesPerCell, m_cellParticles[cell]);
+		}
+		if (!m_liquidCells.empty())
+		{
+			m_stats.meanParticlesPerCell = static_cast<float>(particles.size()) / m_liquidCells.size();
+		}
+		m_stats.gridMemoryUsage = getGridMemoryUsage();
+	}
+}
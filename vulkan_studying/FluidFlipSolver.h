@@ -0,0 +1,105 @@
+#pragma once
+#include "FluidSolver.h"
+
+// Hybrid particle/grid solver (FLIP, Zhu & Bridson 2005; APIC, Jiang et al. 2015).
+// Particles carry the velocity; each step splats it onto a staggered MAC grid, adds body forces,
+// makes the grid divergence free with a matrix-free preconditioned conjugate gradient and reads the
+// velocity back. Only faces next to liquid come out of the projection, the velocity is extrapolated from them
+// into the air so particles at the free surface read divergence free values too.
+// The grid is solid on its outer layer of cells, so the fluid lives in a closed box.
+// Cells are two spawn spacings wide, which puts about eight particles in every fluid cell
+class FluidFlipSolver : public FluidSolver
+{
+public:
+	explicit FluidFlipSolver(FluidHybridTransfer transfer);
+
+	void step(std::vector<FluidParticle>& particles, const FluidParams& params) override;
+	void invalidate() override;
+	// Particles are read every step anyway, and the APIC matrices stay meaningful after a nudge
+	void reloadParticles() override {}
+
+	uint32_t getDimensions() const override { return 3; }
+	size_t getGridMemoryUsage() const override;
+
+	// Walls of the box; unset, the first step takes the particles' bounding box grown by half its size on every side
+	void setDomain(const glm::vec3& minimum, const glm::vec3& maximum);
+	// FLIP only: share of the FLIP velocity update against plain PIC, lower values are more damped
+	void setFlipRatio(float flipRatio) { m_flipRatio = flipRatio; }
+	// The solve stops once the residual falls below tolerance times its starting value
+	void setPressureSolver(float tolerance, uint32_t maxIterations);
+
+private:
+	enum CellType : uint8_t
+	{
+		Air,
+		Liquid,
+		Solid
+	};
+
+	// One velocity component, sampled at the centres of the cell faces normal to its axis
+	struct FaceField
+	{
+		glm::ivec3 size;
+		glm::vec3 offset;// sample position inside cell (0, 0, 0) in cell units
+		std::vector<float> values;
+		std::vector<float> weights;
+		std::vector<float> previous;
+		std::vector<uint8_t> known;// extrapolation layer a value came from, see extrapolateVelocity
+
+		size_t index(int i, int j, int k) const { return (static_cast<size_t>(k) * size.y + j) * size.x + i; }
+	};
+
+	// Base node and fractions of a trilinear stencil around a position in cell units
+	struct Stencil
+	{
+		glm::ivec3 base;
+		glm::vec3 fraction;
+	};
+
+	void setupGrid(const std::vector<FluidParticle>& particles, const FluidParams& params);
+	void transferToGrid(const std::vector<FluidParticle>& particles);
+	void markCells(const std::vector<FluidParticle>& particles);
+	void applyBodyForce(const glm::vec3& acceleration, float timeStep);
+	void enforceBoundaries();
+	uint32_t project();
+	void extrapolateVelocity();
+	void transferToParticles(std::vector<FluidParticle>& particles);
+	void advect(std::vector<FluidParticle>& particles, float timeStep);
+	void storeParticleFields(std::vector<FluidParticle>& particles, const FluidParams& params, float subTimeStep);
+
+	Stencil getStencil(const FaceField& field, const glm::vec3& position) const;
+	glm::vec3 sampleVelocity(const glm::vec3& position) const;
+	glm::vec3 toGrid(const glm::vec3& position) const { return (position - m_origin) * m_inverseCellSize; }
+	size_t getCellIndex(int i, int j, int k) const { return (static_cast<size_t>(k) * m_dimensions.y + j) * m_dimensions.x + i; }
+	void applyPressureMatrix(const std::vector<double>& input, std::vector<double>& output) const;
+
+	FluidHybridTransfer m_transfer;
+	float m_flipRatio = 0.95f;
+	float m_pressureTolerance = 1e-5f;
+	uint32_t m_maxPressureIterations = 200;
+
+	bool m_domainSet = false;
+	glm::vec3 m_domainMinimum;
+	glm::vec3 m_domainMaximum;
+
+	float m_cellSize = 0.0f;
+	float m_inverseCellSize = 0.0f;
+	glm::vec3 m_origin;
+	glm::ivec3 m_dimensions;
+
+	FaceField m_faces[3];
+	std::vector<uint8_t> m_cellTypes;
+	std::vector<uint32_t> m_cellParticles;
+	std::vector<uint32_t> m_liquidCells;
+
+	// Pressure solve, indexed by cell; only liquid cells are ever touched
+	std::vector<double> m_pressure;
+	std::vector<double> m_residual;
+	std::vector<double> m_search;
+	std::vector<double> m_preconditioned;
+	std::vector<double> m_product;
+
+	// APIC: per particle, the gradient of each velocity component
+	std::vector<glm::mat3> m_affine;
+	std::vector<glm::vec3> m_startVelocities;
+};
@@ -0,0 +1,283 @@
+#include "FluidFrameCodec.h"
+
+
+namespace
+{
+	const size_t minMatch = 4;
+	const size_t lastLiterals = 5;
+	const uint32_t hashBits = 16;
+	const size_t maxOffset = 65535;
+
+	void putLength(std::vector<uint8_t>& dst, size_t length)
+	{
+		while (length >= 255)
+		{
+			dst.push_back(255);
+			length -= 255;
+		}
+		dst.push_back(static_cast<uint8_t>(length));
+	}
+
+	size_t getLength(const uint8_t* src, size_t srcSize, size_t& ip)
+	{
+		size_t length = 0;
+		uint8_t byte;
+		do
+		{
+			if (ip >= srcSize)
+			{
+				throw std::runtime_error("corrupted fluid frame");
+			}
+			byte = src[ip++];
+			length += byte;
+		} while (byte == 255);
+		return length;
+	}
+
+	void putVarint(std::vector<uint8_t>& dst, uint32_t value)
+	{
+		while (value >= 0x80)
+		{
+			dst.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		dst.push_back(static_cast<uint8_t>(value));
+	}
+
+	uint32_t getVarint(const std::vector<uint8_t>& src, size_t& ip)
+	{
+		uint32_t value = 0;
+		for (uint32_t shift = 0; shift < 35; shift += 7)
+		{
+			if (ip >= src.size())
+			{
+				throw std::runtime_error("corrupted fluid frame");
+			}
+			uint8_t byte = src[ip++];
+			value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				return value;
+			}
+		}
+		throw std::runtime_error("corrupted fluid frame");
+	}
+}
+
+FluidFrameCodec::FluidFrameCodec(float quantum) :
+	m_quantum(quantum)
+{
+	if (quantum <= 0.0f)
+	{
+		throw std::runtime_error("fluid frame quantum must be positive");
+	}
+}
+
+FluidFrameCodec::~FluidFrameCodec()
+{
+}
+
+bool FluidFrameCodec::encode(const std::vector<glm::vec3>& positions, bool keyframe, std::vector<uint8_t>& frame)
+{
+	const size_t count = positions.size();
+	const float limit = static_cast<float>(std::numeric_limits<int32_t>::max() - 1);
+
+	m_current.resize(count * 3);
+	for (size_t i = 0; i < count; i++)
+	{
+		for (size_t axis = 0; axis < 3; axis++)
+		{
+			float value = glm::clamp(positions[i][axis] / m_quantum, -limit, limit);
+			m_current[axis * count + i] = static_cast<int32_t>(std::lround(value));
+		}
+	}
+
+	// Temporal deltas need the previous frame to have the same particles
+	const bool temporal = !keyframe && m_previous.size() == m_current.size();
+
+	m_raw.clear();
+	m_raw.reserve(count * 3 * 2);
+	for (size_t axis = 0; axis < 3; axis++)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t index = axis * count + i;
+			int32_t reference = temporal ? m_previous[index] : (i > 0 ? m_current[index - 1] : 0);
+			// Wrapping unsigned arithmetic keeps the round trip exact for any pair of coordinates
+			int32_t delta = static_cast<int32_t>(static_cast<uint32_t>(m_current[index]) - static_cast<uint32_t>(reference));
+			putVarint(m_raw, (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31));
+		}
+	}
+
+	m_previous.swap(m_current);
+
+	compress(m_raw, frame);
+	return !temporal;
+}
+
+void FluidFrameCodec::decode(const std::vector<uint8_t>& frame, size_t particlesCount, size_t rawSize, bool keyframe, std::vector<glm::vec3>& positions)
+{
+	decompress(frame.data(), frame.size(), m_raw, rawSize);
+
+	if (!keyframe && m_previous.size() != particlesCount * 3)
+	{
+		throw std::runtime_error("fluid delta frame without matching previous frame");
+	}
+
+	m_current.resize(particlesCount * 3);
+	size_t ip = 0;
+	for (size_t axis = 0; axis < 3; axis++)
+	{
+		for (size_t i = 0; i < particlesCount; i++)
+		{
+			size_t index = axis * particlesCount + i;
+			int32_t reference = !keyframe ? m_previous[index] : (i > 0 ? m_current[index - 1] : 0);
+			uint32_t zigzag = getVarint(m_raw, ip);
+			uint32_t delta = (zigzag >> 1) ^ (0u - (zigzag & 1u));
+			m_current[index] = static_cast<int32_t>(static_cast<uint32_t>(reference) + delta);
+		}
+	}
+
+	positions.resize(particlesCount);
+	for (size_t i = 0; i < particlesCount; i++)
+	{
+		positions[i] = glm::vec3(
+			m_current[i] * m_quantum,
+			m_current[particlesCount + i] * m_quantum,
+			m_current[2 * particlesCount + i] * m_quantum);
+	}
+
+	m_previous.swap(m_current);
+}
+
+void FluidFrameCodec::compress(const std::vector<uint8_t>& src, std::vector<uint8_t>& dst)
+{
+	const size_t size = src.size();
+	dst.clear();
+	dst.reserve(size / 2 + 16);
+
+	std::vector<int64_t> table(size_t(1) << hashBits, -1);
+
+	size_t anchor = 0;
+	size_t ip = 0;
+
+	auto emit = [&](size_t literalsEnd, size_t offset, size_t matchLength)
+	{
+		size_t literals = literalsEnd - anchor;
+		uint8_t token = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+		if (matchLength > 0)
+		{
+			token |= static_cast<uint8_t>(std::min<size_t>(matchLength - minMatch, 15));
+		}
+		dst.push_back(token);
+		if (literals >= 15)
+		{
+			putLength(dst, literals - 15);
+		}
+		dst.insert(dst.end(), src.begin() + anchor, src.begin() + literalsEnd);
+
+		if (matchLength > 0)
+		{
+			dst.push_back(static_cast<uint8_t>(offset & 0xff));
+			dst.push_back(static_cast<uint8_t>(offset >> 8));
+			if (matchLength - minMatch >= 15)
+			{
+				putLength(dst, matchLength - minMatch - 15);
+			}
+		}
+	};
+
+	if (size > minMatch + lastLiterals)
+	{
+		const size_t matchLimit = size - lastLiterals;
+		while (ip + minMatch <= matchLimit)
+		{
+			uint32_t sequence;
+			memcpy(&sequence, &src[ip], sizeof(sequence));
+			uint32_t hash = (sequence * 2654435761u) >> (32 - hashBits);
+			int64_t candidate = table[hash];
+			table[hash] = static_cast<int64_t>(ip);
+
+			if (candidate >= 0 && ip - static_cast<size_t>(candidate) <= maxOffset &&
+				memcmp(&src[static_cast<size_t>(candidate)], &src[ip], minMatch) == 0)
+			{
+				size_t match = static_cast<size_t>(candidate);
+				size_t length = minMatch;
+				while (ip + length < matchLimit && src[match + length] == src[ip + length])
+				{
+					length++;
+				}
+
+				emit(ip, ip - match, length);
+				ip += length;
+				anchor = ip;
+			}
+			else
+			{
+				ip++;
+			}
+		}
+	}
+
+	// The last sequence only carries literals, the decoder stops once they are consumed
+	emit(size, 0, 0);
+}
+
+void FluidFrameCodec::decompress(const uint8_t* src, size_t srcSize, std::vector<uint8_t>& dst, size_t dstSize)
+{
+	dst.resize(dstSize);
+
+	size_t ip = 0;
+	size_t op = 0;
+	while (ip < srcSize)
+	{
+		uint8_t token = src[ip++];
+
+		size_t literals = token >> 4;
+		if (literals == 15)
+		{
+			literals += getLength(src, srcSize, ip);
+		}
+		if (ip + literals > srcSize || op + literals > dstSize)
+		{
+			throw std::runtime_error("corrupted fluid frame");
+		}
+		memcpy(dst.data() + op, src + ip, literals);
+		ip += literals;
+		op += literals;
+
+		if (ip == srcSize)
+		{
+			break;
+		}
+
+		if (ip + 2 > srcSize)
+		{
+			throw std::runtime_error("corrupted fluid frame");
+		}
+		size_t offset = src[ip] | (static_cast<size_t>(src[ip + 1]) << 8);
+		ip += 2;
+
+		size_t length = token & 15;
+		if (length == 15)
+		{
+			length += getLength(src, srcSize, ip);
+		}
+		length += minMatch;
+
+		if (offset == 0 || offset > op || op + length > dstSize)
+		{
+			throw std::runtime_error("corrupted fluid frame");
+		}
+		// Matches may overlap their own output, so copy byte by byte
+		for (size_t i = 0; i < length; i++, op++)
+		{
+			dst[op] = dst[op - offset];
+		}
+	}
+
+	if (op != dstSize)
+	{
+		throw std::runtime_error("corrupted fluid frame");
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "Headers.h"
+
+// On-disk layout of a recording: one FluidRecordingHeader followed by FluidFrameHeader + compressed payload per frame
+struct FluidRecordingHeader
+{
+	char magic[4];
+	uint32_t version;
+	float quantum;
+	uint32_t keyframeInterval;
+};
+
+struct FluidFrameHeader
+{
+	uint32_t frameIndex;
+	uint32_t keyframe;
+	uint64_t particlesCount;
+	uint64_t rawSize;
+	uint64_t compressedSize;
+};
+
+// Turns particle positions into compact frames: positions are snapped to a fixed grid of
+// size quantum, delta-encoded (against the previous frame, or the previous particle on keyframes),
+// zigzag/varint packed and finally run through an LZ4 style byte compressor
+class FluidFrameCodec
+{
+public:
+	FluidFrameCodec(float quantum);
+	~FluidFrameCodec();
+
+	// Returns whether the frame went out as a keyframe, which it does anyway when the particle count has changed
+	bool encode(const std::vector<glm::vec3>& positions, bool keyframe, std::vector<uint8_t>& frame);
+	void decode(const std::vector<uint8_t>& frame, size_t particlesCount, size_t rawSize, bool keyframe, std::vector<glm::vec3>& positions);
+
+	size_t getRawSize() const { return m_raw.size(); }
+	float getQuantum() const { return m_quantum; }
+
+	void reset() { m_previous.clear(); }
+
+	static void compress(const std::vector<uint8_t>& src, std::vector<uint8_t>& dst);
+	static void decompress(const uint8_t* src, size_t srcSize, std::vector<uint8_t>& dst, size_t dstSize);
+
+private:
+	float m_quantum;
+
+	// Quantized coordinates stored per axis (all x, then all y, then all z)
+	std::vector<int32_t> m_current;
+	std::vector<int32_t> m_previous;
+	std::vector<uint8_t> m_raw;
+};
@@ -0,0 +1,289 @@
+#include "FluidFrameRing.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "shared frame ring needs address-free atomics");
+
+namespace
+{
+	const uint32_t ringVersion = 1;
+	// A reader that loses this many races in a row to the writer keeps its previous frame
+	const uint32_t readAttempts = 8;
+
+	std::string getSystemName(const std::string& name)
+	{
+#if defined(_WIN32)
+		return "Local\\" + name;
+#else
+		return "/" + name;
+#endif
+	}
+
+	// Size of the whole ring a mapped header describes; throws unless a writer has finished setting it up
+	size_t getRingSize(const void* memory)
+	{
+		const FluidFrameRingHeader* header = static_cast<const FluidFrameRingHeader*>(memory);
+		if (memcmp(header->magic, "FLRG", sizeof(header->magic)) != 0 || header->version != ringVersion)
+		{
+			throw std::runtime_error("invalid fluid frame ring");
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return static_cast<size_t>(sizeof(FluidFrameRingHeader) + header->slotsCount * header->slotSize);
+	}
+
+	// Particles follow their slot's header; byte pointers keep memcpy away from the atomic in FluidFrameSlot
+	uint8_t* getPayload(FluidFrameSlot* slot)
+	{
+		return reinterpret_cast<uint8_t*>(slot) + sizeof(FluidFrameSlot);
+	}
+
+	const uint8_t* getPayload(const FluidFrameSlot* slot)
+	{
+		return reinterpret_cast<const uint8_t*>(slot) + sizeof(FluidFrameSlot);
+	}
+}
+
+FluidFrameRing::FluidFrameRing(const std::string& name, uint32_t particlesCapacity, uint32_t slotsCount) :
+	m_name(name),
+	m_writer(true)
+{
+	if (slotsCount < 2)
+	{
+		throw std::runtime_error("fluid frame ring needs at least 2 slots");
+	}
+
+	const uint64_t slotSize = (sizeof(FluidFrameSlot) + static_cast<uint64_t>(particlesCapacity) * sizeof(FluidParticle) + 63) / 64 * 64;
+	map(static_cast<size_t>(sizeof(FluidFrameRingHeader) + slotsCount * slotSize), true);
+
+	m_header = new(m_memory) FluidFrameRingHeader();
+	m_header->version = ringVersion;
+	m_header->slotsCount = slotsCount;
+	m_header->particlesCapacity = particlesCapacity;
+	m_header->slotSize = slotSize;
+	m_header->latestFrame.store(0, std::memory_order_relaxed);
+	m_header->closed.store(0, std::memory_order_relaxed);
+	for (uint32_t slot = 0; slot < slotsCount; slot++)
+	{
+		FluidFrameSlot* frameSlot = new(static_cast<uint8_t*>(m_memory) + sizeof(FluidFrameRingHeader) + slot * slotSize) FluidFrameSlot();
+		frameSlot->sequence.store(0, std::memory_order_relaxed);
+		frameSlot->frame = 0;
+		frameSlot->particlesCount = 0;
+	}
+
+	// Readers check the magic last, so they never see a half initialised ring
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(m_header->magic, "FLRG", sizeof(m_header->magic));
+}
+
+FluidFrameRing::FluidFrameRing(const std::string& name) :
+	m_name(name),
+	m_writer(false)
+{
+	// Viewers retry every frame while no writer runs, a failed attempt must not keep anything mapped
+	try
+	{
+		map(sizeof(FluidFrameRingHeader), false);
+		const size_t size = getRingSize(m_memory);
+
+		// Now that the header is known, map the slots as well. A writer restarted in between may have made
+		// a ring of another size under the same name
+		map(size, false);
+		if (getRingSize(m_memory) != size)
+		{
+			throw std::runtime_error("fluid frame ring changed while opening it");
+		}
+	}
+	catch (...)
+	{
+		unmap();
+		throw;
+	}
+	m_header = static_cast<FluidFrameRingHeader*>(m_memory);
+}
+
+FluidFrameRing::~FluidFrameRing()
+{
+	if (m_memory == nullptr)
+	{
+		return;
+	}
+
+	if (m_writer)
+	{
+		m_header->closed.store(1, std::memory_order_release);
+	}
+
+	unmap();
+#if !defined(_WIN32)
+	if (m_writer)
+	{
+		// Mapped readers keep the memory alive, the name is free for the next writer
+		shm_unlink(getSystemName(m_name).c_str());
+	}
+#endif
+}
+
+void FluidFrameRing::publish(const std::vector<FluidParticle>& particles)
+{
+	if (!m_writer)
+	{
+		throw std::runtime_error("fluid frame ring was opened for reading");
+	}
+	if (particles.size() > m_header->particlesCapacity)
+	{
+		throw std::runtime_error("too many particles for the fluid frame ring");
+	}
+
+	const uint64_t frame = m_header->latestFrame.load(std::memory_order_relaxed) + 1;
+	FluidFrameSlot* slot = getSlot(frame);
+
+	uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+	slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot->frame = frame;
+	slot->particlesCount = particles.size();
+	memcpy(getPayload(slot), particles.data(), particles.size() * sizeof(FluidParticle));
+
+	slot->sequence.store(sequence + 2, std::memory_order_release);
+	m_header->latestFrame.store(frame, std::memory_order_release);
+}
+
+bool FluidFrameRing::readLatest(std::vector<FluidParticle>& particles)
+{
+	for (uint32_t attempt = 0; attempt < readAttempts; attempt++)
+	{
+		const uint64_t frame = m_header->latestFrame.load(std::memory_order_acquire);
+		if (frame == 0 || frame == m_lastReadFrame)
+		{
+			return false;
+		}
+
+		const FluidFrameSlot* slot = getSlot(frame);
+		uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+		if (sequence & 1)
+		{
+			continue;
+		}
+
+		size_t count = static_cast<size_t>(std::min<uint64_t>(slot->particlesCount, m_header->particlesCapacity));
+		particles.resize(count);
+		memcpy(particles.data(), getPayload(slot), count * sizeof(FluidParticle));
+
+		// The copy only counts if the writer did not touch the slot meanwhile
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot->sequence.load(std::memory_order_relaxed) == sequence && slot->frame == frame)
+		{
+			m_lastReadFrame = frame;
+			return true;
+		}
+	}
+	return false;
+}
+
+void FluidFrameRing::map(size_t size, bool create)
+{
+	const std::string systemName = getSystemName(m_name);
+
+#if defined(_WIN32)
+	if (m_memory != nullptr)
+	{
+		UnmapViewOfFile(m_memory);
+		m_memory = nullptr;
+	}
+	if (m_handle == nullptr)
+	{
+		m_handle = create ?
+			CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), systemName.c_str()) :
+			OpenFileMappingA(FILE_MAP_READ, FALSE, systemName.c_str());
+		if (m_handle == nullptr)
+		{
+			throw std::runtime_error("failed to open fluid frame ring");
+		}
+	}
+	m_memory = MapViewOfFile(m_handle, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size);
+	if (m_memory == nullptr)
+	{
+		throw std::runtime_error("failed to map fluid frame ring");
+	}
+#else
+	if (m_memory != nullptr)
+	{
+		munmap(m_memory, m_size);
+		m_memory = nullptr;
+	}
+
+	int file;
+	if (create)
+	{
+		// A ring left behind by a crashed writer is dropped, readers still mapping it keep their copy
+		shm_unlink(systemName.c_str());
+		file = shm_open(systemName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (file >= 0 && ftruncate(file, static_cast<off_t>(size)) != 0)
+		{
+			close(file);
+			shm_unlink(systemName.c_str());
+			file = -1;
+		}
+	}
+	else
+	{
+		file = shm_open(systemName.c_str(), O_RDONLY, 0);
+	}
+	if (file < 0)
+	{
+		throw std::runtime_error("failed to open fluid frame ring");
+	}
+
+	// Touching pages past the end of the object raises SIGBUS; a writer starting up has not sized it yet
+	struct stat status;
+	if (!create && (fstat(file, &status) != 0 || static_cast<uint64_t>(status.st_size) < size))
+	{
+		close(file);
+		throw std::runtime_error("fluid frame ring is not ready");
+	}
+
+	void* memory = mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+	if (memory == MAP_FAILED)
+	{
+		throw std::runtime_error("failed to map fluid frame ring");
+	}
+	m_memory = memory;
+#endif
+
+	m_size = size;
+}
+
+void FluidFrameRing::unmap()
+{
+	if (m_memory != nullptr)
+	{
+#if defined(_WIN32)
+		UnmapViewOfFile(m_memory);
+#else
+		munmap(m_memory, m_size);
+#endif
+		m_memory = nullptr;
+	}
+#if defined(_WIN32)
+	if (m_handle != nullptr)
+	{
+		CloseHandle(m_handle);
+		m_handle = nullptr;
+	}
+#endif
+}
+
+FluidFrameSlot* FluidFrameRing::getSlot(uint64_t frame) const
+{
+	uint8_t* slots = reinterpret_cast<uint8_t*>(m_header) + sizeof(FluidFrameRingHeader);
+	return reinterpret_cast<FluidFrameSlot*>(slots + (frame % m_header->slotsCount) * m_header->slotSize);
+}
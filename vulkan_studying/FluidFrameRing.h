@@ -0,0 +1,63 @@
+#pragma once
+#include "Fluid.h"
+
+#include <atomic>
+
+// Shared memory layout: one FluidFrameRingHeader, then slotsCount slots of FluidFrameSlot + particlesCapacity particles.
+// Frame n (counted from 1) goes to slot n % slotsCount; each slot is a seqlock whose sequence is odd while it is written
+struct alignas(64) FluidFrameRingHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t slotsCount;
+	uint32_t particlesCapacity;
+	uint64_t slotSize;
+	std::atomic<uint64_t> latestFrame;// 0 until the first frame is complete
+	std::atomic<uint32_t> closed;// set once the writer has gone
+};
+
+struct alignas(64) FluidFrameSlot
+{
+	std::atomic<uint64_t> sequence;
+	uint64_t frame;
+	uint64_t particlesCount;
+};
+
+// Lock-free frame ring between a simulation process and a render process on one machine.
+// The writer never waits: it overwrites the oldest slot, and a reader caught mid-copy by a lapping writer just
+// retries with the newest frame. Readers only ever map the memory, so viewers come and go while the writer runs
+class FluidFrameRing
+{
+public:
+	// Writer: creates (or replaces) the named ring
+	FluidFrameRing(const std::string& name, uint32_t particlesCapacity, uint32_t slotsCount = 4);
+	// Reader: maps a ring some writer created, read only
+	explicit FluidFrameRing(const std::string& name);
+	~FluidFrameRing();
+
+	FluidFrameRing(const FluidFrameRing&) = delete;
+	FluidFrameRing& operator=(const FluidFrameRing&) = delete;
+
+	void publish(const std::vector<FluidParticle>& particles);
+	// Copies the newest complete frame if it is newer than the last one read, otherwise leaves particles alone
+	bool readLatest(std::vector<FluidParticle>& particles);
+
+	uint64_t getLatestFrame() const { return m_header->latestFrame.load(std::memory_order_acquire); }
+	uint64_t getLastReadFrame() const { return m_lastReadFrame; }
+	// The writer shut down; a restarted one creates a fresh ring, so a reader has to open the name again
+	bool isClosed() const { return m_header->closed.load(std::memory_order_acquire) != 0; }
+
+private:
+	void map(size_t size, bool create);
+	void unmap();
+	FluidFrameSlot* getSlot(uint64_t frame) const;
+
+	std::string m_name;
+	bool m_writer;
+	size_t m_size = 0;
+	void* m_memory = nullptr;
+	void* m_handle = nullptr;// file mapping handle on Windows
+
+	FluidFrameRingHeader* m_header = nullptr;
+	uint64_t m_lastReadFrame = 0;
+};
@@ -0,0 +1,116 @@
+#pragma once
+#include "FluidKernels.h"
+#include "HugePageAllocator.h"
+
+// Dense uniform grid over the particles' bounding box, rebuilt every step with a counting sort
+template<int Dimensions, typename Scalar>
+class FluidGrid
+{
+public:
+	typedef typename FluidVector<Dimensions, Scalar>::type Vector;
+	typedef typename FluidVector<Dimensions, int>::type Cell;
+
+	void build(const HugePageVector<Vector>& positions, Scalar cellSize)
+	{
+		const size_t count = positions.size();
+		m_inverseCellSize = Scalar(1) / cellSize;
+
+		Vector minimum(std::numeric_limits<Scalar>::max());
+		Vector maximum(std::numeric_limits<Scalar>::lowest());
+		for (const auto& position : positions)
+		{
+			minimum = glm::min(minimum, position);
+			maximum = glm::max(maximum, position);
+		}
+		if (count == 0)
+		{
+			minimum = maximum = Vector(Scalar(0));
+		}
+
+		m_origin = minimum;
+		m_dimensions = getFluidCell<Cell>((maximum - minimum) * m_inverseCellSize) + 1;
+
+		const size_t cellsCount = getFluidCellsCount(m_dimensions);
+		m_cellStart.assign(cellsCount + 1, 0);
+		m_particleCells.resize(count);
+		m_sortedIndices.resize(count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t cell = static_cast<uint32_t>(getIndex(getCell(positions[i])));
+			m_particleCells[i] = cell;
+			m_cellStart[cell + 1]++;
+		}
+
+		for (size_t cell = 0; cell < cellsCount; cell++)
+		{
+			m_cellStart[cell + 1] += m_cellStart[cell];
+		}
+
+		// Scatter with a moving cursor per cell, restoring the start offsets afterwards
+		for (size_t i = 0; i < count; i++)
+		{
+			m_sortedIndices[m_cellStart[m_particleCells[i]]++] = static_cast<uint32_t>(i);
+		}
+		for (size_t cell = cellsCount; cell > 0; cell--)
+		{
+			m_cellStart[cell] = m_cellStart[cell - 1];
+		}
+		m_cellStart[0] = 0;
+	}
+
+	template<typename Function>
+	void forEachNeighbour(const Vector& position, Function function) const
+	{
+		auto visitCell = [&](const Cell& cell)
+		{
+			size_t index = getIndex(cell);
+			for (uint32_t i = m_cellStart[index]; i < m_cellStart[index + 1]; i++)
+			{
+				function(m_sortedIndices[i]);
+			}
+		};
+		FluidCellRange<Dimensions>::forEachClamped(getCell(position), m_dimensions, visitCell);
+	}
+
+	size_t getCellsCount() const { return m_cellStart.empty() ? 0 : m_cellStart.size() - 1; }
+	FluidCellOccupancy getOccupancy() const
+	{
+		FluidCellOccupancy occupancy;
+		for (size_t cell = 0; cell < getCellsCount(); cell++)
+		{
+			uint32_t count = m_cellStart[cell + 1] - m_cellStart[cell];
+			occupancy.occupiedCells += count != 0;
+			occupancy.maxParticles = std::max(occupancy.maxParticles, count);
+		}
+		return occupancy;
+	}
+	size_t getMemoryUsage() const
+	{
+		return (m_cellStart.capacity() + m_sortedIndices.capacity() + m_particleCells.capacity()) * sizeof(uint32_t);
+	}
+
+private:
+	Cell getCell(const Vector& position) const
+	{
+		return getFluidCell<Cell>((position - m_origin) * m_inverseCellSize);
+	}
+
+	size_t getIndex(const Cell& cell) const
+	{
+		size_t index = 0;
+		for (int axis = Dimensions - 1; axis >= 0; axis--)
+		{
+			index = index * m_dimensions[axis] + cell[axis];
+		}
+		return index;
+	}
+
+	Vector m_origin;
+	Scalar m_inverseCellSize = Scalar(1);
+	Cell m_dimensions;
+
+	HugePageVector<uint32_t> m_cellStart;
+	HugePageVector<uint32_t> m_sortedIndices;
+	HugePageVector<uint32_t> m_particleCells;
+};
@@ -0,0 +1,197 @@
+#pragma once
+#include "FluidKernels.h"
+#include "HugePageAllocator.h"
+
+// Sparse grid for mostly empty domains: an open addressing hash table keyed by cell coordinate,
+// so memory follows the number of occupied cells instead of the bounding box volume
+template<int Dimensions, typename Scalar>
+class FluidHashGrid
+{
+public:
+	typedef typename FluidVector<Dimensions, Scalar>::type Vector;
+	typedef typename FluidVector<Dimensions, int>::type Cell;
+
+	FluidHashGrid() :
+		m_table(16, Slot()),
+		m_mask(15)
+	{
+	}
+
+	void build(const HugePageVector<Vector>& positions, Scalar cellSize)
+	{
+		const size_t count = positions.size();
+		m_inverseCellSize = Scalar(1) / cellSize;
+
+		// Size the table from last step's occupancy so the load factor starts below one half
+		size_t capacity = 16;
+		while (capacity < 2 * m_occupiedCount)
+		{
+			capacity <<= 1;
+		}
+		m_table.assign(capacity, Slot());
+		m_mask = capacity - 1;
+		m_occupiedCount = 0;
+
+		m_particleCells.resize(count);
+		m_sortedIndices.resize(count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			Cell cell = getCell(positions[i]);
+			m_particleCells[i] = cell;
+			insert(cell).count++;
+		}
+
+		uint32_t offset = 0;
+		for (auto& slot : m_table)
+		{
+			slot.start = offset;
+			offset += slot.count;
+		}
+
+		// start doubles as the scatter cursor, then gets rewound by count
+		for (size_t i = 0; i < count; i++)
+		{
+			Slot* slot = const_cast<Slot*>(find(m_particleCells[i]));
+			m_sortedIndices[slot->start++] = static_cast<uint32_t>(i);
+		}
+		for (auto& slot : m_table)
+		{
+			slot.start -= slot.count;
+		}
+	}
+
+	template<typename Function>
+	void forEachNeighbour(const Vector& position, Function function) const
+	{
+		auto visitCell = [&](const Cell& cell)
+		{
+			const Slot* slot = find(cell);
+			if (slot == nullptr) return;
+			for (uint32_t i = slot->start; i < slot->start + slot->count; i++)
+			{
+				function(m_sortedIndices[i]);
+			}
+		};
+		FluidCellRange<Dimensions>::forEach(getCell(position), visitCell);
+	}
+
+	size_t getCellsCount() const { return m_occupiedCount; }
+	FluidCellOccupancy getOccupancy() const
+	{
+		FluidCellOccupancy occupancy;
+		occupancy.occupiedCells = m_occupiedCount;
+		for (const auto& slot : m_table)
+		{
+			occupancy.maxParticles = std::max(occupancy.maxParticles, slot.count);
+		}
+		return occupancy;
+	}
+	size_t getMemoryUsage() const
+	{
+		return m_table.capacity() * sizeof(Slot) +
+			m_particleCells.capacity() * sizeof(Cell) +
+			m_sortedIndices.capacity() * sizeof(uint32_t);
+	}
+
+private:
+	// A slot is empty while its count is zero, occupied cells always hold at least one particle
+	struct Slot
+	{
+		Cell coordinate;
+		uint32_t start = 0;
+		uint32_t count = 0;
+	};
+
+	Cell getCell(const Vector& position) const
+	{
+		return getFluidCell<Cell>(position * m_inverseCellSize);
+	}
+
+	static uint32_t hash(const Cell& coordinate)
+	{
+		static const uint32_t primes[3] = { 73856093u, 19349663u, 83492791u };
+		uint32_t h = 0;
+		for (int axis = 0; axis < Dimensions; axis++)
+		{
+			h ^= static_cast<uint32_t>(coordinate[axis]) * primes[axis];
+		}
+		// Slots come from the low bits, which a plain multiply only fills from the low bits of the coordinates;
+		// the murmur3 finaliser spreads every input bit over all of them
+		h ^= h >> 16;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35u;
+		h ^= h >> 16;
+		return h;
+	}
+
+	const Slot* find(const Cell& coordinate) const
+	{
+		for (size_t slot = hash(coordinate) & m_mask; m_table[slot].count != 0; slot = (slot + 1) & m_mask)
+		{
+			if (m_table[slot].coordinate == coordinate)
+			{
+				return &m_table[slot];
+			}
+		}
+		return nullptr;
+	}
+
+	Slot& insert(const Cell& coordinate)
+	{
+		size_t slot = hash(coordinate) & m_mask;
+		while (m_table[slot].count != 0)
+		{
+			if (m_table[slot].coordinate == coordinate)
+			{
+				return m_table[slot];
+			}
+			slot = (slot + 1) & m_mask;
+		}
+
+		if (2 * (m_occupiedCount + 1) > m_table.size())
+		{
+			grow();
+			slot = hash(coordinate) & m_mask;
+			while (m_table[slot].count != 0)
+			{
+				slot = (slot + 1) & m_mask;
+			}
+		}
+
+		m_table[slot].coordinate = coordinate;
+		m_occupiedCount++;
+		return m_table[slot];
+	}
+
+	void grow()
+	{
+		std::vector<Slot> old;
+		old.swap(m_table);
+
+		m_table.assign(old.size() * 2, Slot());
+		m_mask = m_table.size() - 1;
+
+		for (const auto& cell : old)
+		{
+			if (cell.count == 0) continue;
+
+			size_t slot = hash(cell.coordinate) & m_mask;
+			while (m_table[slot].count != 0)
+			{
+				slot = (slot + 1) & m_mask;
+			}
+			m_table[slot] = cell;
+		}
+	}
+
+	Scalar m_inverseCellSize = Scalar(1);
+
+	std::vector<Slot> m_table;
+	size_t m_mask = 0;
+	size_t m_occupiedCount = 0;
+
+	HugePageVector<Cell> m_particleCells;
+	HugePageVector<uint32_t> m_sortedIndices;
+};
@@ -0,0 +1,251 @@
+#pragma once
+#include "FluidKernels.h"
+#include "HugePageAllocator.h"
+
+// Dense grid that is patched instead of rebuilt: every cell owns a run of slots with some slack,
+// and an update only moves the particles whose cell changed. A full rebuild happens when a cell
+// runs out of slack, a particle leaves the padded bounds, the cell size or particle count changes,
+// or every rebuildInterval updates to recentre the bounds and restore slack
+template<int Dimensions, typename Scalar>
+class FluidIncrementalGrid
+{
+public:
+	typedef typename FluidVector<Dimensions, Scalar>::type Vector;
+	typedef typename FluidVector<Dimensions, int>::type Cell;
+
+	void build(const HugePageVector<Vector>& positions, Scalar cellSize)
+	{
+		if (cellSize != m_cellSize || positions.size() != m_particleCells.size() || m_updatesSinceRebuild >= m_rebuildInterval)
+		{
+			rebuild(positions, cellSize);
+			return;
+		}
+
+		m_movedCount = 0;
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			Cell cell = getCell(positions[i]);
+			if (!contains(cell))
+			{
+				rebuild(positions, cellSize);
+				return;
+			}
+
+			uint32_t index = static_cast<uint32_t>(getIndex(cell));
+			if (index == m_particleCells[i]) continue;
+
+			if (m_cellCount[index] == getCapacity(index))
+			{
+				rebuild(positions, cellSize);
+				return;
+			}
+			remove(static_cast<uint32_t>(i));
+			insert(static_cast<uint32_t>(i), index);
+			m_movedCount++;
+		}
+		m_updatesSinceRebuild++;
+	}
+
+	template<typename Function>
+	void forEachNeighbour(const Vector& position, Function function) const
+	{
+		auto visitCell = [&](const Cell& cell)
+		{
+			size_t index = getIndex(cell);
+			for (uint32_t i = m_cellStart[index]; i < m_cellStart[index] + m_cellCount[index]; i++)
+			{
+				function(m_slots[i]);
+			}
+		};
+		FluidCellRange<Dimensions>::forEachClamped(getCell(position), m_dimensions, visitCell);
+	}
+
+	// Extra slots given on a rebuild to every occupied cell and its empty neighbours, as count * slackFactor + minimumSlack
+	void setSlack(float slackFactor, uint32_t minimumSlack)
+	{
+		m_slackFactor = slackFactor;
+		m_minimumSlack = minimumSlack;
+	}
+	void setRebuildInterval(uint32_t rebuildInterval) { m_rebuildInterval = std::max(rebuildInterval, 1u); }
+
+	// Particles that changed cell in the last update, all of them after a rebuild
+	size_t getMovedCount() const { return m_movedCount; }
+	size_t getRebuildsCount() const { return m_rebuildsCount; }
+
+	size_t getCellsCount() const { return m_cellCount.size(); }
+	FluidCellOccupancy getOccupancy() const
+	{
+		FluidCellOccupancy occupancy;
+		for (uint32_t count : m_cellCount)
+		{
+			occupancy.occupiedCells += count != 0;
+			occupancy.maxParticles = std::max(occupancy.maxParticles, count);
+		}
+		return occupancy;
+	}
+	size_t getMemoryUsage() const
+	{
+		return (m_cellStart.capacity() + m_cellCount.capacity() + m_slots.capacity() +
+			m_particleCells.capacity() + m_particleSlots.capacity()) * sizeof(uint32_t);
+	}
+
+private:
+	// Cells of margin around the particles' bounding box, so a slow fluid can spread before a rebuild
+	static const int margin = 2;
+
+	void rebuild(const HugePageVector<Vector>& positions, Scalar cellSize)
+	{
+		const size_t count = positions.size();
+		m_cellSize = cellSize;
+		m_inverseCellSize = Scalar(1) / cellSize;
+
+		Vector minimum(std::numeric_limits<Scalar>::max());
+		Vector maximum(std::numeric_limits<Scalar>::lowest());
+		for (const auto& position : positions)
+		{
+			minimum = glm::min(minimum, position);
+			maximum = glm::max(maximum, position);
+		}
+		if (count == 0)
+		{
+			minimum = maximum = Vector(Scalar(0));
+		}
+
+		m_origin = minimum - Vector(cellSize * margin);
+		m_dimensions = getFluidCell<Cell>((maximum - minimum) * m_inverseCellSize) + (2 * margin + 1);
+
+		const size_t cellsCount = getFluidCellsCount(m_dimensions);
+		m_cellCount.assign(cellsCount, 0);
+		m_cellStart.resize(cellsCount + 1);
+		m_particleCells.resize(count);
+		m_particleSlots.resize(count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t cell = static_cast<uint32_t>(getIndex(getCell(positions[i])));
+			m_particleCells[i] = cell;
+			m_cellCount[cell]++;
+		}
+
+		// Slack goes to occupied cells and the empty ones around them, where particles move next; cells further
+		// out get no slots, so memory follows the fluid and not the padded box. m_cellStart flags the shell first
+		std::fill(m_cellStart.begin(), m_cellStart.end(), 0u);
+		auto markCell = [&](const Cell& cell)
+		{
+			m_cellStart[getIndex(cell)] = 1;
+		};
+		for (size_t cell = 0; cell < cellsCount; cell++)
+		{
+			if (m_cellCount[cell] != 0)
+			{
+				FluidCellRange<Dimensions>::forEachClamped(getCoordinate(cell), m_dimensions, markCell);
+			}
+		}
+
+		// Slots are indexed with 32 bits, the total is counted in 64
+		uint64_t offset = 0;
+		for (size_t cell = 0; cell < cellsCount; cell++)
+		{
+			const bool reserved = m_cellStart[cell] != 0;
+			const uint32_t cellCount = m_cellCount[cell];
+			m_cellStart[cell] = static_cast<uint32_t>(offset);
+			if (reserved)
+			{
+				offset += cellCount + static_cast<uint32_t>(cellCount * m_slackFactor) + m_minimumSlack;
+			}
+			if (offset > std::numeric_limits<uint32_t>::max())
+			{
+				throw std::runtime_error("fluid particles need too many incremental grid slots");
+			}
+		}
+		m_cellStart[cellsCount] = static_cast<uint32_t>(offset);
+		m_slots.assign(static_cast<size_t>(offset), 0);
+
+		std::fill(m_cellCount.begin(), m_cellCount.end(), 0u);
+		for (size_t i = 0; i < count; i++)
+		{
+			insert(static_cast<uint32_t>(i), m_particleCells[i]);
+		}
+
+		m_movedCount = count;
+		m_updatesSinceRebuild = 0;
+		m_rebuildsCount++;
+	}
+
+	// Swap with the last particle of the cell so occupied slots stay contiguous
+	void remove(uint32_t particle)
+	{
+		uint32_t cell = m_particleCells[particle];
+		uint32_t slot = m_particleSlots[particle];
+		uint32_t last = m_cellStart[cell] + --m_cellCount[cell];
+
+		m_slots[slot] = m_slots[last];
+		m_particleSlots[m_slots[slot]] = slot;
+	}
+
+	void insert(uint32_t particle, uint32_t cell)
+	{
+		uint32_t slot = m_cellStart[cell] + m_cellCount[cell]++;
+		m_slots[slot] = particle;
+		m_particleSlots[particle] = slot;
+		m_particleCells[particle] = cell;
+	}
+
+	uint32_t getCapacity(size_t cell) const { return m_cellStart[cell + 1] - m_cellStart[cell]; }
+
+	Cell getCell(const Vector& position) const
+	{
+		return getFluidCell<Cell>((position - m_origin) * m_inverseCellSize);
+	}
+
+	Cell getCoordinate(size_t index) const
+	{
+		Cell cell;
+		for (int axis = 0; axis < Dimensions; axis++)
+		{
+			cell[axis] = static_cast<int>(index % m_dimensions[axis]);
+			index /= m_dimensions[axis];
+		}
+		return cell;
+	}
+
+	bool contains(const Cell& cell) const
+	{
+		for (int axis = 0; axis < Dimensions; axis++)
+		{
+			if (cell[axis] < 0 || cell[axis] >= m_dimensions[axis]) return false;
+		}
+		return true;
+	}
+
+	size_t getIndex(const Cell& cell) const
+	{
+		size_t index = 0;
+		for (int axis = Dimensions - 1; axis >= 0; axis--)
+		{
+			index = index * m_dimensions[axis] + cell[axis];
+		}
+		return index;
+	}
+
+	Vector m_origin;
+	Scalar m_cellSize = Scalar(0);
+	Scalar m_inverseCellSize = Scalar(1);
+	Cell m_dimensions;
+
+	float m_slackFactor = 0.5f;
+	uint32_t m_minimumSlack = 4;
+	uint32_t m_rebuildInterval = 64;
+	uint32_t m_updatesSinceRebuild = 0;
+
+	size_t m_movedCount = 0;
+	size_t m_rebuildsCount = 0;
+
+	// Cell c owns slots [m_cellStart[c], m_cellStart[c + 1]), the first m_cellCount[c] of them in use
+	HugePageVector<uint32_t> m_cellStart;
+	HugePageVector<uint32_t> m_cellCount;
+	HugePageVector<uint32_t> m_slots;
+
+	HugePageVector<uint32_t> m_particleCells;
+	HugePageVector<uint32_t> m_particleSlots;
+};
@@ -0,0 +1,264 @@
+#pragma once
+#include "Headers.h"
+
+#include <glm/gtc/constants.hpp>
+
+enum class FluidKernelType
+{
+	Poly6Spiky,
+	Wendland,
+	CubicSpline
+};
+
+enum class FluidPrecision
+{
+	Single,
+	Double
+};
+
+// How the hybrid solver moves velocity between particles and grid
+enum class FluidHybridTransfer
+{
+	Flip,// lively, slightly noisy
+	Apic// keeps rotation without FLIP noise
+};
+
+template<int Dimensions, typename Scalar>
+struct FluidVector;
+
+template<typename Scalar>
+struct FluidVector<2, Scalar>
+{
+	typedef glm::tvec2<Scalar, glm::defaultp> type;
+};
+
+template<typename Scalar>
+struct FluidVector<3, Scalar>
+{
+	typedef glm::tvec3<Scalar, glm::defaultp> type;
+};
+
+// Visits the block of cells around (and including) a cell, 3^Dimensions of them
+template<int Dimensions>
+struct FluidCellRange;
+
+template<>
+struct FluidCellRange<2>
+{
+	template<typename Cell, typename Function>
+	static void forEach(const Cell& center, Function& function)
+	{
+		for (int y = center.y - 1; y <= center.y + 1; y++)
+			for (int x = center.x - 1; x <= center.x + 1; x++)
+				function(Cell(x, y));
+	}
+
+	// Only the cells inside [0, dimensions)
+	template<typename Cell, typename Function>
+	static void forEachClamped(const Cell& center, const Cell& dimensions, Function& function)
+	{
+		for (int y = std::max(center.y - 1, 0); y <= std::min(center.y + 1, dimensions.y - 1); y++)
+			for (int x = std::max(center.x - 1, 0); x <= std::min(center.x + 1, dimensions.x - 1); x++)
+				function(Cell(x, y));
+	}
+};
+
+template<>
+struct FluidCellRange<3>
+{
+	template<typename Cell, typename Function>
+	static void forEach(const Cell& center, Function& function)
+	{
+		for (int z = center.z - 1; z <= center.z + 1; z++)
+			for (int y = center.y - 1; y <= center.y + 1; y++)
+				for (int x = center.x - 1; x <= center.x + 1; x++)
+					function(Cell(x, y, z));
+	}
+
+	template<typename Cell, typename Function>
+	static void forEachClamped(const Cell& center, const Cell& dimensions, Function& function)
+	{
+		for (int z = std::max(center.z - 1, 0); z <= std::min(center.z + 1, dimensions.z - 1); z++)
+			for (int y = std::max(center.y - 1, 0); y <= std::min(center.y + 1, dimensions.y - 1); y++)
+				for (int x = std::max(center.x - 1, 0); x <= std::min(center.x + 1, dimensions.x - 1); x++)
+					function(Cell(x, y, z));
+	}
+};
+
+// The cell a position in cell units falls in. Converting a value an int can't hold is undefined, so exploded or
+// non finite positions throw instead; the bound leaves room for grid margins and neighbour offsets
+template<typename Cell, typename Vector>
+Cell getFluidCell(const Vector& scaled)
+{
+	typedef typename Vector::value_type Scalar;
+	const Scalar limit = static_cast<Scalar>(std::numeric_limits<int>::max() / 2);
+	for (int axis = 0; axis < Cell::length(); axis++)
+	{
+		// Negated so NaN fails too
+		if (!(std::abs(scaled[axis]) < limit))
+		{
+			throw std::runtime_error("fluid particle outside of the neighbour grid's range");
+		}
+	}
+	return Cell(glm::floor(scaled));
+}
+
+// Cells of a dense grid with these dimensions, which must fit its 32 bit cell indices and offsets
+template<typename Cell>
+size_t getFluidCellsCount(const Cell& dimensions)
+{
+	uint64_t cellsCount = 1;
+	for (int axis = 0; axis < Cell::length(); axis++)
+	{
+		cellsCount *= static_cast<uint64_t>(dimensions[axis]);
+		if (cellsCount >= std::numeric_limits<uint32_t>::max())
+		{
+			throw std::runtime_error("fluid particles spread over too many grid cells");
+		}
+	}
+	return static_cast<size_t>(cellsCount);
+}
+
+// Cells holding at least one particle and the fullest of them, for solver stats
+struct FluidCellOccupancy
+{
+	size_t occupiedCells = 0;
+	uint32_t maxParticles = 0;
+};
+
+// Kernels share one interface, all with support radius h:
+//   value(r2)      W for a squared distance r2 < h^2
+//   gradient(r)    dW/dr for 0 < r < h, multiplied by the unit direction by the caller
+//   laplacian(r)   viscosity Laplacian for 0 < r < h
+// Constants are folded in the constructor so the per-pair code is plain arithmetic
+
+// Poly6 for density, spiky for pressure and the viscosity kernel Laplacian (Muller et al. 2003)
+template<int Dimensions, typename Scalar>
+class Poly6SpikyKernel
+{
+public:
+	explicit Poly6SpikyKernel(Scalar h) :
+		m_h(h),
+		m_h2(h * h)
+	{
+		const Scalar pi = glm::pi<Scalar>();
+		if (Dimensions == 2)
+		{
+			m_poly6 = Scalar(4) / (pi * std::pow(h, Scalar(8)));
+			m_spiky = Scalar(-30) / (pi * std::pow(h, Scalar(5)));
+			m_viscosity = Scalar(40) / (pi * std::pow(h, Scalar(5)));
+		}
+		else
+		{
+			m_poly6 = Scalar(315) / (Scalar(64) * pi * std::pow(h, Scalar(9)));
+			m_spiky = Scalar(-45) / (pi * std::pow(h, Scalar(6)));
+			m_viscosity = Scalar(45) / (pi * std::pow(h, Scalar(6)));
+		}
+	}
+
+	Scalar value(Scalar r2) const
+	{
+		Scalar w = m_h2 - r2;
+		return m_poly6 * w * w * w;
+	}
+
+	Scalar gradient(Scalar r) const
+	{
+		Scalar w = m_h - r;
+		return m_spiky * w * w;
+	}
+
+	Scalar laplacian(Scalar r) const
+	{
+		return m_viscosity * (m_h - r);
+	}
+
+private:
+	Scalar m_h;
+	Scalar m_h2;
+	Scalar m_poly6;
+	Scalar m_spiky;
+	Scalar m_viscosity;
+};
+
+// Wendland C2, W = sigma (1 - q)^4 (1 + 4q) with q = r / h
+template<int Dimensions, typename Scalar>
+class WendlandKernel
+{
+public:
+	explicit WendlandKernel(Scalar h) :
+		m_inverseH(Scalar(1) / h)
+	{
+		const Scalar pi = glm::pi<Scalar>();
+		m_sigma = Dimensions == 2 ?
+			Scalar(7) / (pi * h * h) :
+			Scalar(21) / (Scalar(2) * pi * h * h * h);
+	}
+
+	Scalar value(Scalar r2) const
+	{
+		Scalar q = std::sqrt(r2) * m_inverseH;
+		Scalar w = Scalar(1) - q;
+		Scalar w2 = w * w;
+		return m_sigma * w2 * w2 * (Scalar(1) + Scalar(4) * q);
+	}
+
+	Scalar gradient(Scalar r) const
+	{
+		Scalar q = r * m_inverseH;
+		Scalar w = Scalar(1) - q;
+		return Scalar(-20) * m_sigma * m_inverseH * q * w * w * w;
+	}
+
+	// Brookshaw approximation, -2/r dW/dr
+	Scalar laplacian(Scalar r) const
+	{
+		return Scalar(-2) * gradient(r) / r;
+	}
+
+private:
+	Scalar m_inverseH;
+	Scalar m_sigma;
+};
+
+// Monaghan cubic B-spline with support h, evaluated on q = 2r / h
+template<int Dimensions, typename Scalar>
+class CubicSplineKernel
+{
+public:
+	explicit CubicSplineKernel(Scalar h) :
+		m_twoOverH(Scalar(2) / h)
+	{
+		const Scalar pi = glm::pi<Scalar>();
+		m_sigma = Dimensions == 2 ?
+			Scalar(40) / (Scalar(7) * pi * h * h) :
+			Scalar(8) / (pi * h * h * h);
+	}
+
+	Scalar value(Scalar r2) const
+	{
+		Scalar q = std::sqrt(r2) * m_twoOverH;
+		Scalar outer = Scalar(2) - q;
+		Scalar inner = Scalar(1) - q;
+		// (2 - q)^3 / 4 - (1 - q)^3 on the inner lobe, selected without branching
+		Scalar innerPart = std::max(inner, Scalar(0));
+		return m_sigma * (Scalar(0.25) * outer * outer * outer - innerPart * innerPart * innerPart);
+	}
+
+	Scalar gradient(Scalar r) const
+	{
+		Scalar q = r * m_twoOverH;
+		Scalar outer = Scalar(2) - q;
+		Scalar innerPart = std::max(Scalar(1) - q, Scalar(0));
+		return m_sigma * m_twoOverH * (Scalar(-0.75) * outer * outer + Scalar(3) * innerPart * innerPart);
+	}
+
+	Scalar laplacian(Scalar r) const
+	{
+		return Scalar(-2) * gradient(r) / r;
+	}
+
+private:
+	Scalar m_twoOverH;
+	Scalar m_sigma;
+};
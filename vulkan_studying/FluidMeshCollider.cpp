@@ -0,0 +1,141 @@
+#include "FluidMeshCollider.h"
+#include "Parallel.h"
+
+
+void FluidMeshCollider::addObject(Object* object)
+{
+	m_objects.push_back(object);
+	m_objectsChanged = true;
+}
+
+void FluidMeshCollider::removeObject(Object* object)
+{
+	m_objects.erase(std::remove(m_objects.begin(), m_objects.end(), object), m_objects.end());
+	m_objectsChanged = true;
+}
+
+void FluidMeshCollider::update()
+{
+	m_positions.clear();
+	m_indices.clear();
+	for (Object* object : m_objects)
+	{
+		uint32_t base = static_cast<uint32_t>(m_positions.size());
+		const glm::mat4& transform = object->getTransform();
+		for (const Vertex& vertex : object->getVertices())
+		{
+			m_positions.push_back(glm::vec3(transform * glm::vec4(vertex.position, 1.0f)));
+		}
+		for (uint32_t index : object->getIndices())
+		{
+			m_indices.push_back(base + index);
+		}
+	}
+
+	if (m_objectsChanged || m_indices != m_bvh.getIndices())
+	{
+		m_bvh.build(m_positions, m_indices);
+		m_objectsChanged = false;
+		m_buildsCount++;
+		return;
+	}
+
+	m_bvh.refit(m_positions);
+	m_refitsCount++;
+	// Refit boxes grow loose as triangles drift apart, past some point a fresh build is cheaper than the queries
+	if (m_bvh.getCost() > m_rebuildRatio * m_bvh.getBuildCost())
+	{
+		m_bvh.build(m_positions, m_indices);
+		m_buildsCount++;
+	}
+}
+
+size_t FluidMeshCollider::collide(std::vector<FluidParticle>& particles, const FluidParams& params) const
+{
+	if (m_bvh.getTrianglesCount() == 0)
+	{
+		return 0;
+	}
+
+	// Blocks keep the shared counter of parallelFor off the per particle path
+	const size_t blockSize = 256;
+	const size_t blocksCount = (particles.size() + blockSize - 1) / blockSize;
+	const float radius = params.particleRadius;
+	std::atomic<size_t> collisionsCount(0);
+	parallelFor(blocksCount, [&](size_t block)
+	{
+		size_t collisions = 0;
+		size_t end = std::min(particles.size(), (block + 1) * blockSize);
+		for (size_t i = block * blockSize; i < end; i++)
+		{
+			collisions += collideParticle(particles[i], radius) ? 1 : 0;
+		}
+		collisionsCount += collisions;
+	}, m_threadsCount);
+	return collisionsCount;
+}
+
+bool FluidMeshCollider::collideParticle(FluidParticle& particle, float radius) const
+{
+	const std::vector<glm::vec3>& positions = m_bvh.getPositions();
+	const std::vector<uint32_t>& indices = m_bvh.getIndices();
+
+	// The nearest contact is resolved first, a second pass settles particles wedged into a crease
+	bool moved = false;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		float nearestDistance2 = radius * radius;
+		glm::vec3 nearestPoint;
+		uint32_t nearestTriangle = std::numeric_limits<uint32_t>::max();
+
+		auto test = [&](uint32_t triangle)
+		{
+			glm::vec3 point = TriangleBvh::closestPointOnTriangle(particle.position,
+				positions[indices[3 * triangle]], positions[indices[3 * triangle + 1]], positions[indices[3 * triangle + 2]]);
+			glm::vec3 offset = particle.position - point;
+			float distance2 = glm::dot(offset, offset);
+			if (distance2 < nearestDistance2)
+			{
+				nearestDistance2 = distance2;
+				nearestPoint = point;
+				nearestTriangle = triangle;
+			}
+		};
+		m_bvh.forEachTriangle(particle.position, radius, test);
+
+		if (nearestTriangle == std::numeric_limits<uint32_t>::max())
+		{
+			return moved;
+		}
+
+		glm::vec3 normal;
+		float distance = std::sqrt(nearestDistance2);
+		if (distance > 1e-6f * radius)
+		{
+			normal = (particle.position - nearestPoint) / distance;
+		}
+		else
+		{
+			// Centre on the surface: leave along the face normal, the winding decides the side
+			const glm::vec3& a = positions[indices[3 * nearestTriangle]];
+			glm::vec3 face = glm::cross(positions[indices[3 * nearestTriangle + 1]] - a, positions[indices[3 * nearestTriangle + 2]] - a);
+			float length = glm::length(face);
+			if (length <= 0.0f)
+			{
+				return moved;
+			}
+			normal = face / length;
+		}
+
+		particle.position = nearestPoint + normal * radius;
+		moved = true;
+
+		float normalSpeed = glm::dot(particle.velocity, normal);
+		if (normalSpeed < 0.0f)
+		{
+			glm::vec3 tangential = particle.velocity - normalSpeed * normal;
+			particle.velocity = tangential * (1.0f - m_friction) - normal * (normalSpeed * m_restitution);
+		}
+	}
+	return moved;
+}
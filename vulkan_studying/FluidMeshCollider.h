@@ -0,0 +1,51 @@
+#pragma once
+#include "Fluid.h"
+#include "Object.h"
+#include "TriangleBvh.h"
+
+// Object meshes as fluid obstacles. All meshes share one hierarchy in world space; a particle closer
+// to a triangle than its radius is pushed out to the radius and loses the velocity into the triangle.
+// Meshes act as thin shells, so a particle must not cross one within a single step
+class FluidMeshCollider
+{
+public:
+	void addObject(Object* object);
+	void removeObject(Object* object);
+
+	// Call once per frame after objects moved or deformed. Moved vertices only refit the hierarchy;
+	// changed triangles, or a refit tree expected to cost rebuildRatio times a fresh one, rebuild it
+	void update();
+
+	// Queries run in parallel over blocks of particles, each thread on its own traversal stack.
+	// Returns the number of particles moved
+	size_t collide(std::vector<FluidParticle>& particles, const FluidParams& params) const;
+
+	// Share of the normal speed kept on contact, 0 stops the particle dead against the wall
+	void setRestitution(float restitution) { m_restitution = restitution; }
+	// Share of the tangential speed lost on contact
+	void setFriction(float friction) { m_friction = friction; }
+	void setRebuildRatio(float rebuildRatio) { m_rebuildRatio = rebuildRatio; }
+	void setThreadsCount(uint32_t threadsCount) { m_threadsCount = threadsCount; }
+
+	const TriangleBvh& getBvh() const { return m_bvh; }
+	uint32_t getBuildsCount() const { return m_buildsCount; }
+	uint32_t getRefitsCount() const { return m_refitsCount; }
+
+private:
+	bool collideParticle(FluidParticle& particle, float radius) const;
+
+	std::vector<Object*> m_objects;
+	bool m_objectsChanged = true;
+
+	TriangleBvh m_bvh;
+	std::vector<glm::vec3> m_positions;
+	std::vector<uint32_t> m_indices;
+
+	float m_restitution = 0.0f;
+	float m_friction = 0.0f;
+	float m_rebuildRatio = 2.0f;
+	uint32_t m_threadsCount = 0;
+
+	uint32_t m_buildsCount = 0;
+	uint32_t m_refitsCount = 0;
+};
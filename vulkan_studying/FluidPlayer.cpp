@@ -0,0 +1,139 @@
+#include "FluidPlayer.h"
+
+
+FluidPlayer::FluidPlayer(const std::string& filename, size_t readAheadFrames, bool loop) :
+	m_file(filename, std::ios::binary),
+	m_readAheadFrames(std::max<size_t>(readAheadFrames, 1)),
+	m_loop(loop)
+{
+	if (!m_file.is_open())
+	{
+		throw std::runtime_error("failed to open fluid recording file");
+	}
+
+	m_file.read(reinterpret_cast<char*>(&m_header), sizeof(m_header));
+	if (!m_file || memcmp(m_header.magic, "FLRC", sizeof(m_header.magic)) != 0 || m_header.version != 1)
+	{
+		throw std::runtime_error("invalid fluid recording file");
+	}
+
+	m_codec.reset(new FluidFrameCodec(m_header.quantum));
+	m_reader = std::thread(&FluidPlayer::readerLoop, this);
+}
+
+FluidPlayer::~FluidPlayer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_queueChanged.notify_all();
+	m_reader.join();
+}
+
+bool FluidPlayer::nextFrame(std::vector<FluidParticle>& particles)
+{
+	std::vector<glm::vec3> positions;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_queueChanged.wait(lock, [this] { return !m_queue.empty() || m_finished; });
+		if (m_queue.empty())
+		{
+			if (m_error)
+			{
+				std::rethrow_exception(m_error);
+			}
+			return false;
+		}
+		positions.swap(m_queue.front());
+		m_queue.pop_front();
+	}
+	m_queueChanged.notify_all();
+
+	particles.resize(positions.size());
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		particles[i].position = positions[i];
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_freeBuffers.push_back(std::move(positions));
+	}
+	return true;
+}
+
+void FluidPlayer::readerLoop()
+{
+	try
+	{
+		while (true)
+		{
+			std::vector<glm::vec3> positions;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_queueChanged.wait(lock, [this] { return m_queue.size() < m_readAheadFrames || m_stopping; });
+				if (m_stopping)
+				{
+					break;
+				}
+				if (!m_freeBuffers.empty())
+				{
+					positions.swap(m_freeBuffers.back());
+					m_freeBuffers.pop_back();
+				}
+			}
+
+			if (!readFrame(positions))
+			{
+				if (!m_loop)
+				{
+					break;
+				}
+				// Rewind to the first frame, which is always a keyframe
+				m_file.clear();
+				m_file.seekg(sizeof(FluidRecordingHeader));
+				m_codec->reset();
+				if (!readFrame(positions))
+				{
+					break;
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_queue.push_back(std::move(positions));
+			}
+			m_queueChanged.notify_all();
+		}
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_error = std::current_exception();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_finished = true;
+	}
+	m_queueChanged.notify_all();
+}
+
+bool FluidPlayer::readFrame(std::vector<glm::vec3>& positions)
+{
+	FluidFrameHeader header;
+	if (!m_file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+	{
+		return false;
+	}
+
+	m_frame.resize(static_cast<size_t>(header.compressedSize));
+	if (!m_file.read(reinterpret_cast<char*>(m_frame.data()), m_frame.size()))
+	{
+		throw std::runtime_error("truncated fluid recording file");
+	}
+
+	m_codec->decode(m_frame, static_cast<size_t>(header.particlesCount), static_cast<size_t>(header.rawSize), header.keyframe != 0, positions);
+	return true;
+}
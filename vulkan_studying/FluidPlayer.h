@@ -0,0 +1,42 @@
+#pragma once
+#include "Fluid.h"
+#include "FluidFrameCodec.h"
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <memory>
+
+// Streams a FluidRecorder file back, decoding up to readAheadFrames frames ahead on its own thread
+class FluidPlayer
+{
+public:
+	FluidPlayer(const std::string& filename, size_t readAheadFrames = 4, bool loop = true);
+	~FluidPlayer();
+
+	// Copies the next frame's positions into particles, returns false once a non looping recording ends
+	bool nextFrame(std::vector<FluidParticle>& particles);
+
+private:
+	void readerLoop();
+	bool readFrame(std::vector<glm::vec3>& positions);
+
+	std::ifstream m_file;
+	FluidRecordingHeader m_header;
+	std::unique_ptr<FluidFrameCodec> m_codec;
+	size_t m_readAheadFrames;
+	bool m_loop;
+
+	std::deque<std::vector<glm::vec3>> m_queue;
+	std::vector<std::vector<glm::vec3>> m_freeBuffers;
+	std::vector<uint8_t> m_frame;
+	bool m_finished = false;
+	bool m_stopping = false;
+	std::exception_ptr m_error;
+
+	std::mutex m_mutex;
+	std::condition_variable m_queueChanged;
+	std::thread m_reader;
+};
@@ -0,0 +1,154 @@
+#include "FluidRecorder.h"
+
+
+FluidRecorder::FluidRecorder(const std::string& filename, float quantum, uint32_t keyframeInterval, size_t maxQueuedFrames) :
+	m_file(filename, std::ios::binary | std::ios::trunc),
+	m_codec(quantum),
+	m_keyframeInterval(std::max(keyframeInterval, 1u)),
+	m_maxQueuedFrames(std::max<size_t>(maxQueuedFrames, 1))
+{
+	if (!m_file.is_open())
+	{
+		throw std::runtime_error("failed to open fluid recording file");
+	}
+
+	FluidRecordingHeader header = {};
+	memcpy(header.magic, "FLRC", sizeof(header.magic));
+	header.version = 1;
+	header.quantum = quantum;
+	header.keyframeInterval = m_keyframeInterval;
+	m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!m_file)
+	{
+		throw std::runtime_error("failed to write fluid recording file");
+	}
+	m_bytesWritten += sizeof(header);
+
+	m_writer = std::thread(&FluidRecorder::writerLoop, this);
+}
+
+FluidRecorder::~FluidRecorder()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_queueChanged.notify_all();
+	m_writer.join();
+
+	// Destructors can't throw, a failure nobody was told about yet goes to the log
+	if (m_failed && !m_failureReported)
+	{
+		std::cerr << "failed to write fluid recording file, the recording is truncated" << std::endl;
+	}
+}
+
+void FluidRecorder::checkFailed()
+{
+	if (m_failed)
+	{
+		m_failureReported = true;
+		throw std::runtime_error("failed to write fluid recording file");
+	}
+}
+
+void FluidRecorder::push(const std::vector<FluidParticle>& particles)
+{
+	checkFailed();
+
+	std::vector<glm::vec3> positions;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_queueChanged.wait(lock, [this] { return m_queue.size() < m_maxQueuedFrames; });
+		if (!m_freeBuffers.empty())
+		{
+			positions.swap(m_freeBuffers.back());
+			m_freeBuffers.pop_back();
+		}
+		m_pendingFrames++;
+	}
+
+	positions.resize(particles.size());
+	for (size_t i = 0; i < particles.size(); i++)
+	{
+		positions[i] = particles[i].position;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(std::move(positions));
+	}
+	m_queueChanged.notify_all();
+}
+
+void FluidRecorder::flush()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_queueChanged.wait(lock, [this] { return m_pendingFrames == 0; });
+	if (!m_failed && !m_file.flush())
+	{
+		m_failed = true;
+	}
+	lock.unlock();
+	checkFailed();
+}
+
+void FluidRecorder::writerLoop()
+{
+	std::vector<uint8_t> frame;
+	uint32_t frameIndex = 0;
+
+	while (true)
+	{
+		std::vector<glm::vec3> positions;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_queueChanged.wait(lock, [this] { return !m_queue.empty() || (m_stopping && m_pendingFrames == 0); });
+			if (m_queue.empty())
+			{
+				break;
+			}
+			positions.swap(m_queue.front());
+			m_queue.pop_front();
+		}
+		m_queueChanged.notify_all();
+
+		// After a failed write the queue is still drained, so push() never blocks on a writer that gave up
+		if (!m_failed)
+		{
+			// The codec has the last word, a frame whose particle count changed can't be a delta frame
+			bool keyframe = m_codec.encode(positions, frameIndex % m_keyframeInterval == 0, frame);
+
+			FluidFrameHeader header = {};
+			header.frameIndex = frameIndex++;
+			header.keyframe = keyframe ? 1 : 0;
+			header.particlesCount = positions.size();
+			header.rawSize = m_codec.getRawSize();
+			header.compressedSize = frame.size();
+
+			m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			m_file.write(reinterpret_cast<const char*>(frame.data()), frame.size());
+			if (m_file)
+			{
+				m_framesWritten++;
+				m_bytesWritten += sizeof(header) + frame.size();
+			}
+			else
+			{
+				m_failed = true;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_freeBuffers.push_back(std::move(positions));
+			m_pendingFrames--;
+		}
+		m_queueChanged.notify_all();
+	}
+
+	if (!m_failed && !m_file.flush())
+	{
+		m_failed = true;
+	}
+}
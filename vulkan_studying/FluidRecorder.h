@@ -0,0 +1,49 @@
+#pragma once
+#include "Fluid.h"
+#include "FluidFrameCodec.h"
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+// Writes fluid frames to disk on its own thread, the simulation thread only copies positions
+class FluidRecorder
+{
+public:
+	FluidRecorder(const std::string& filename, float quantum, uint32_t keyframeInterval = 60, size_t maxQueuedFrames = 4);
+	~FluidRecorder();
+
+	// Blocks only when maxQueuedFrames frames are still waiting for the writer. Both throw once a write has
+	// failed, the recording is cut short then and later frames are dropped
+	void push(const std::vector<FluidParticle>& particles);
+	void flush();
+
+	uint64_t getFramesWritten() const { return m_framesWritten; }
+	uint64_t getBytesWritten() const { return m_bytesWritten; }
+
+private:
+	void writerLoop();
+	void checkFailed();
+
+	std::ofstream m_file;
+	FluidFrameCodec m_codec;
+	uint32_t m_keyframeInterval;
+	size_t m_maxQueuedFrames;
+
+	std::deque<std::vector<glm::vec3>> m_queue;
+	std::vector<std::vector<glm::vec3>> m_freeBuffers;
+	size_t m_pendingFrames = 0;
+	bool m_stopping = false;
+
+	std::mutex m_mutex;
+	std::condition_variable m_queueChanged;
+	std::thread m_writer;
+
+	std::atomic<uint64_t> m_framesWritten{ 0 };
+	std::atomic<uint64_t> m_bytesWritten{ 0 };
+	// Set by the writer when the stream goes bad, reported by the simulation thread
+	std::atomic<bool> m_failed{ false };
+	bool m_failureReported = false;
+};
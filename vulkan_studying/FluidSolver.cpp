@@ -0,0 +1,45 @@
+#include "FluidSphSolver.h"
+#include "FluidFlipSolver.h"
+
+namespace
+{
+	template<int Dimensions, typename Scalar>
+	std::unique_ptr<FluidSolver> createSolver(FluidKernelType kernelType)
+	{
+		switch (kernelType)
+		{
+		case FluidKernelType::Poly6Spiky:
+			return std::unique_ptr<FluidSolver>(new FluidSphSolver<Dimensions, Poly6SpikyKernel, Scalar>);
+		case FluidKernelType::Wendland:
+			return std::unique_ptr<FluidSolver>(new FluidSphSolver<Dimensions, WendlandKernel, Scalar>);
+		case FluidKernelType::CubicSpline:
+			return std::unique_ptr<FluidSolver>(new FluidSphSolver<Dimensions, CubicSplineKernel, Scalar>);
+		}
+		throw std::runtime_error("unknown fluid kernel type");
+	}
+
+	template<int Dimensions>
+	std::unique_ptr<FluidSolver> createSolver(FluidKernelType kernelType, FluidPrecision precision)
+	{
+		return precision == FluidPrecision::Double ?
+			createSolver<Dimensions, double>(kernelType) :
+			createSolver<Dimensions, float>(kernelType);
+	}
+}
+
+std::unique_ptr<FluidSolver> FluidSolver::create(uint32_t dimensions, FluidKernelType kernelType, FluidPrecision precision)
+{
+	switch (dimensions)
+	{
+	case 2:
+		return createSolver<2>(kernelType, precision);
+	case 3:
+		return createSolver<3>(kernelType, precision);
+	}
+	throw std::runtime_error("fluid solver supports only 2 or 3 dimensions");
+}
+
+std::unique_ptr<FluidSolver> FluidSolver::createHybrid(FluidHybridTransfer transfer)
+{
+	return std::unique_ptr<FluidSolver>(new FluidFlipSolver(transfer));
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include "Fluid.h"
+#include "FluidKernels.h"
+
+enum class FluidGridType
+{
+	Dense,
+	Hashed,
+	// Dense grid patched in place, for slow scenes where few particles change cell per step
+	Incremental
+};
+
+// Counters of the last step, filled while stats are enabled
+struct FluidSolverStats
+{
+	static const uint32_t histogramBuckets = 16;
+	static const uint32_t histogramBucketWidth = 8;
+
+	uint64_t step = 0;
+
+	// Wall time per phase, summed over the step's sub-ticks
+	double gridSeconds = 0.0;
+	double densitySeconds = 0.0;
+	double forceSeconds = 0.0;
+	double integrateSeconds = 0.0;
+	double transferSeconds = 0.0;// hybrid solver: particle to grid and back
+	double pressureSeconds = 0.0;// hybrid solver: pressure projection
+	double totalSeconds = 0.0;
+
+	// SPH is explicit and counts one pressure solve per active sub-tick; the hybrid solver counts CG iterations
+	uint32_t pressureIterations = 0;
+	uint64_t particleUpdates = 0;
+
+	// |density - rest| / rest over all particles at the end of the step
+	float maxDensityError = 0.0f;
+	float meanDensityError = 0.0f;
+
+	// Neighbours within h, the particle itself included, from each particle's latest density pass.
+	// Bucket b counts particles with [b * width, (b + 1) * width) neighbours, the last one everything above
+	float meanNeighbours = 0.0f;
+	uint32_t maxNeighbours = 0;
+	uint32_t neighbourHistogram[histogramBuckets] = {};
+
+	size_t cellsCount = 0;
+	size_t occupiedCellsCount = 0;
+	float meanParticlesPerCell = 0.0f;// over occupied cells
+	uint32_t maxParticlesPerCell = 0;
+	size_t gridMemoryUsage = 0;
+};
+
+// Lap timer for splitting a step into phases
+class FluidPhaseTimer
+{
+public:
+	FluidPhaseTimer() : m_last(std::chrono::high_resolution_clock::now()) {}
+
+	// Seconds since construction or the previous lap
+	double lap()
+	{
+		auto now = std::chrono::high_resolution_clock::now();
+		double seconds = std::chrono::duration<double>(now - m_last).count();
+		m_last = now;
+		return seconds;
+	}
+
+private:
+	std::chrono::high_resolution_clock::time_point m_last;
+};
+
+// Runtime face of the SPH solver. The actual solver is FluidSphSolver, specialised at compile time
+// on dimension, kernel family and scalar type; create() picks the instantiation once
+class FluidSolver
+{
+public:
+	// First core value that lets the solver reserve cores of its own
+	static const uint32_t anyCore = ~0u;
+
+	virtual ~FluidSolver() {}
+
+	static std::unique_ptr<FluidSolver> create(uint32_t dimensions, FluidKernelType kernelType, FluidPrecision precision);
+	// FLIP/APIC on a MAC grid, 3D single precision; ignores grid type and time step levels
+	static std::unique_ptr<FluidSolver> createHybrid(FluidHybridTransfer transfer);
+
+	virtual void step(std::vector<FluidParticle>& particles, const FluidParams& params) = 0;
+
+	// Drops the solver's own copy of the particle state, the next step reloads it from the particles
+	virtual void invalidate() = 0;
+	// Particles were only nudged from outside, e.g. by collisions: reread them but keep per particle history
+	virtual void reloadParticles() { invalidate(); }
+
+	virtual uint32_t getDimensions() const = 0;
+	virtual size_t getGridMemoryUsage() const = 0;
+
+	void setGridType(FluidGridType gridType) { m_gridType = gridType; }
+	FluidGridType getGridType() const { return m_gridType; }
+
+	// Particles advance with timeStep / 2^level, level <= maxLevel picked from their CFL limit; 0 keeps one global step
+	void setMaxTimeStepLevel(uint32_t maxLevel) { m_maxLevel = std::min(maxLevel, 15u); }
+	uint32_t getMaxTimeStepLevel() const { return m_maxLevel; }
+	void setCourantFactor(float courantFactor) { m_courantFactor = courantFactor; }
+
+	// Threads for the per-particle passes, 0 meaning all cores; each keeps the same particle range step after step
+	void setThreadsCount(uint32_t threadsCount) { m_threadsCount = threadsCount; }
+	uint32_t getThreadsCount() const { return m_threadsCount; }
+	// Worker threads are pinned to consecutive cores from this one, by default to cores no other pool was given;
+	// the thread calling step() is never pinned
+	void setFirstCore(uint32_t firstCore) { m_firstCore = firstCore; }
+	uint32_t getFirstCore() const { return m_firstCore; }
+
+	// Phase times and iteration counts are always kept; enabling stats adds one pass over particles and cells per step
+	void setStatsEnabled(bool enabled) { m_statsEnabled = enabled; }
+	bool getStatsEnabled() const { return m_statsEnabled; }
+	const FluidSolverStats& getStats() const { return m_stats; }
+
+	void copySettings(const FluidSolver& other)
+	{
+		m_gridType = other.m_gridType;
+		m_maxLevel = other.m_maxLevel;
+		m_courantFactor = other.m_courantFactor;
+		m_statsEnabled = other.m_statsEnabled;
+		m_threadsCount = other.m_threadsCount;
+		m_firstCore = other.m_firstCore;
+	}
+
+protected:
+	FluidGridType m_gridType = FluidGridType::Dense;
+	uint32_t m_maxLevel = 0;
+	float m_courantFactor = 0.4f;
+	uint32_t m_threadsCount = 1;
+	uint32_t m_firstCore = anyCore;
+
+	bool m_statsEnabled = false;
+	FluidSolverStats m_stats;
+};
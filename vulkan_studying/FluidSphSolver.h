@@ -0,0 +1,460 @@
+#pragma once
+#include "FluidSolver.h"
+#include "FluidGrid.h"
+#include "FluidHashGrid.h"
+#include "FluidIncrementalGrid.h"
+#include "Parallel.h"
+
+#include <memory>
+
+// Weakly compressible SPH (Muller et al. 2003) with cells of one smoothing length.
+// Dimension, kernel family and scalar type are template parameters so every per-pair loop
+// is a fixed, fully inlined sequence of arithmetic for its combination.
+// State lives here in Scalar precision and is mirrored into the FluidParticle array after each step.
+// The per-particle passes run on a pool of pinned workers that each own one fixed range of particles, and load()
+// writes each range from its owner first, so with huge pages on a NUMA machine a thread's particles sit on its
+// local node. Block steps that only update some particles still hand each one to the owner of its range.
+template<int Dimensions, template<int, typename> class Kernel, typename Scalar>
+class FluidSphSolver : public FluidSolver
+{
+public:
+	typedef typename FluidVector<Dimensions, Scalar>::type Vector;
+	typedef Kernel<Dimensions, Scalar> KernelFunction;
+
+	void step(std::vector<FluidParticle>& particles, const FluidParams& params) override
+	{
+		FluidPhaseTimer stepTimer;
+		m_timer.lap();
+		resetStats();
+
+		if (m_invalid || m_positions.size() != particles.size())
+		{
+			load(particles);
+		}
+		if (m_levelCounts.size() != m_maxLevel + 1)
+		{
+			m_levelCounts.assign(m_maxLevel + 1, 0);
+			for (auto& level : m_levels)
+			{
+				level = static_cast<uint8_t>(std::min<uint32_t>(level, m_maxLevel));
+				m_levelCounts[level]++;
+			}
+		}
+
+		const KernelFunction kernel(static_cast<Scalar>(params.smoothingLength));
+
+		// The base step is cut into 2^maxLevel sub-ticks, a particle on level L is due every 2^(maxLevel - L) of them
+		const uint32_t subTicks = 1u << m_maxLevel;
+		const Scalar subTimeStep = static_cast<Scalar>(params.timeStep) / subTicks;
+		Scalar pendingDrift = Scalar(0);
+
+		for (uint32_t tick = 0; tick < subTicks; tick++)
+		{
+			uint32_t dueLevel = 0;
+			if (tick != 0)
+			{
+				uint32_t stride = tick & (0u - tick);
+				while ((subTicks >> dueLevel) != stride)
+				{
+					dueLevel++;
+				}
+			}
+
+			size_t dueCount = 0;
+			for (uint32_t level = dueLevel; level <= m_maxLevel; level++)
+			{
+				dueCount += m_levelCounts[level];
+			}
+
+			if (dueCount != 0)
+			{
+				const uint32_t* indices = nullptr;
+				if (dueLevel != 0)
+				{
+					m_activeIndices.clear();
+					for (size_t i = 0; i < m_levels.size(); i++)
+					{
+						if (m_levels[i] >= dueLevel)
+						{
+							m_activeIndices.push_back(static_cast<uint32_t>(i));
+						}
+					}
+					indices = m_activeIndices.data();
+				}
+
+				// Particles between their own updates keep coasting, so everybody drifts before the grid is rebuilt
+				drift(pendingDrift);
+				pendingDrift = Scalar(0);
+				m_stats.integrateSeconds += m_timer.lap();
+
+				switch (m_gridType)
+				{
+				case FluidGridType::Dense:
+					solve(kernel, m_grid, params, indices, dueCount);
+					break;
+				case FluidGridType::Hashed:
+					solve(kernel, m_hashGrid, params, indices, dueCount);
+					break;
+				case FluidGridType::Incremental:
+					solve(kernel, m_incrementalGrid, params, indices, dueCount);
+					break;
+				}
+
+				kick(params, indices, dueCount, tick);
+				m_stats.integrateSeconds += m_timer.lap();
+
+				m_stats.pressureIterations++;
+				m_stats.particleUpdates += dueCount;
+			}
+
+			pendingDrift += subTimeStep;
+		}
+
+		drift(pendingDrift);
+		store(particles);
+		m_stats.integrateSeconds += m_timer.lap();
+
+		if (m_statsEnabled)
+		{
+			gatherStats(params);
+		}
+		m_stats.totalSeconds = stepTimer.lap();
+	}
+
+	void invalidate() override { m_invalid = true; }
+
+	uint32_t getDimensions() const override { return Dimensions; }
+	size_t getGridMemoryUsage() const override
+	{
+		switch (m_gridType)
+		{
+		case FluidGridType::Hashed:
+			return m_hashGrid.getMemoryUsage();
+		case FluidGridType::Incremental:
+			return m_incrementalGrid.getMemoryUsage();
+		default:
+			return m_grid.getMemoryUsage();
+		}
+	}
+
+private:
+	// Rebuilt when the threads count or first core changes, otherwise the workers live as long as the solver
+	WorkerPool& getWorkers() const
+	{
+		const uint32_t threadsCount = m_threadsCount == 0 ? hardwareThreads() : m_threadsCount;
+		if (!m_workers || m_workers->getThreadsCount() != threadsCount || m_workersFirstCore != m_firstCore)
+		{
+			m_workers.reset();
+			// The caller is worker 0, only the others take a core
+			const uint32_t firstCore = m_firstCore == anyCore ? reserveCores(threadsCount - 1) : m_firstCore;
+			m_workers.reset(new WorkerPool(threadsCount, firstCore));
+			m_workersFirstCore = m_firstCore;
+		}
+		return *m_workers;
+	}
+
+	// Runs function(i) for every particle, or for indices[0, count) when given, on the worker owning i.
+	// Indices come in ascending order, so the due particles of one range are a contiguous run of them
+	template<typename Function>
+	void forEachDueParticle(const uint32_t* indices, size_t count, Function function)
+	{
+		WorkerPool& workers = getWorkers();
+		const size_t particlesCount = m_positions.size();
+		workers.run([&](uint32_t thread)
+		{
+			const size_t begin = workers.getRangeBegin(particlesCount, thread);
+			const size_t end = workers.getRangeBegin(particlesCount, thread + 1);
+			if (indices == nullptr)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					function(i);
+				}
+				return;
+			}
+
+			const uint32_t* first = std::lower_bound(indices, indices + count, static_cast<uint32_t>(begin));
+			const uint32_t* last = std::lower_bound(first, indices + count, static_cast<uint32_t>(end));
+			for (const uint32_t* index = first; index != last; index++)
+			{
+				function(*index);
+			}
+		});
+	}
+
+	template<typename Grid>
+	void solve(const KernelFunction& kernel, Grid& grid, const FluidParams& params, const uint32_t* indices, size_t count)
+	{
+		grid.build(m_positions, static_cast<Scalar>(params.smoothingLength));
+		m_stats.gridSeconds += m_timer.lap();
+		computeDensities(kernel, grid, params, indices, count);
+		m_stats.densitySeconds += m_timer.lap();
+		computeForces(kernel, grid, params, indices, count);
+		m_stats.forceSeconds += m_timer.lap();
+	}
+
+	void resetStats()
+	{
+		uint64_t step = m_stats.step + 1;
+		m_stats = FluidSolverStats();
+		m_stats.step = step;
+	}
+
+	void gatherStats(const FluidParams& params)
+	{
+		const size_t count = m_positions.size();
+		const Scalar restDensity = static_cast<Scalar>(params.particleRestingDensity);
+
+		double densityError = 0.0;
+		uint64_t neighbours = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			float error = static_cast<float>(std::abs(m_densities[i] - restDensity) / restDensity);
+			m_stats.maxDensityError = std::max(m_stats.maxDensityError, error);
+			densityError += error;
+
+			uint32_t neighbourCount = m_neighbourCounts[i];
+			m_stats.maxNeighbours = std::max(m_stats.maxNeighbours, neighbourCount);
+			m_stats.neighbourHistogram[std::min(neighbourCount / FluidSolverStats::histogramBucketWidth, FluidSolverStats::histogramBuckets - 1)]++;
+			neighbours += neighbourCount;
+		}
+		if (count != 0)
+		{
+			m_stats.meanDensityError = static_cast<float>(densityError / count);
+			m_stats.meanNeighbours = static_cast<float>(static_cast<double>(neighbours) / count);
+		}
+
+		FluidCellOccupancy occupancy;
+		switch (m_gridType)
+		{
+		case FluidGridType::Dense:
+			occupancy = m_grid.getOccupancy();
+			m_stats.cellsCount = m_grid.getCellsCount();
+			break;
+		case FluidGridType::Hashed:
+			occupancy = m_hashGrid.getOccupancy();
+			m_stats.cellsCount = m_hashGrid.getCellsCount();
+			break;
+		case FluidGridType::Incremental:
+			occupancy = m_incrementalGrid.getOccupancy();
+			m_stats.cellsCount = m_incrementalGrid.getCellsCount();
+			break;
+		}
+		m_stats.occupiedCellsCount = occupancy.occupiedCells;
+		m_stats.maxParticlesPerCell = occupancy.maxParticles;
+		if (occupancy.occupiedCells != 0)
+		{
+			m_stats.meanParticlesPerCell = static_cast<float>(count) / occupancy.occupiedCells;
+		}
+		m_stats.gridMemoryUsage = getGridMemoryUsage();
+	}
+
+	// indices == nullptr runs the pass over every particle
+	template<typename Grid>
+	void computeDensities(const KernelFunction& kernel, const Grid& grid, const FluidParams& params, const uint32_t* indices, size_t count)
+	{
+		const Scalar h2 = static_cast<Scalar>(params.smoothingLength) * static_cast<Scalar>(params.smoothingLength);
+		const Scalar mass = static_cast<Scalar>(params.particleMass);
+
+		forEachDueParticle(indices, count, [&](size_t i)
+		{
+			const Vector position = m_positions[i];
+			Scalar density = Scalar(0);
+			uint32_t neighbours = 0;
+
+			grid.forEachNeighbour(position, [&](uint32_t j)
+			{
+				Vector r = m_positions[j] - position;
+				Scalar r2 = glm::dot(r, r);
+				if (r2 < h2)
+				{
+					density += kernel.value(r2);
+					neighbours++;
+				}
+			});
+
+			m_neighbourCounts[i] = neighbours;
+			m_densities[i] = mass * density;
+			m_pressures[i] = static_cast<Scalar>(params.particleStiffness) * (m_densities[i] - static_cast<Scalar>(params.particleRestingDensity));
+		});
+	}
+
+	template<typename Grid>
+	void computeForces(const KernelFunction& kernel, const Grid& grid, const FluidParams& params, const uint32_t* indices, size_t count)
+	{
+		const Scalar h2 = static_cast<Scalar>(params.smoothingLength) * static_cast<Scalar>(params.smoothingLength);
+		const Scalar mass = static_cast<Scalar>(params.particleMass);
+		const Scalar viscosity = static_cast<Scalar>(params.particleViscosity);
+
+		Vector bodyForce;
+		for (int axis = 0; axis < Dimensions; axis++)
+		{
+			bodyForce[axis] = static_cast<Scalar>(params.force[axis]);
+		}
+
+		forEachDueParticle(indices, count, [&](size_t i)
+		{
+			const Vector position = m_positions[i];
+			const Vector velocity = m_velocities[i];
+			const Scalar pressure = m_pressures[i];
+			Vector pressureForce(Scalar(0));
+			Vector viscosityForce(Scalar(0));
+
+			grid.forEachNeighbour(position, [&](uint32_t j)
+			{
+				if (j == i) return;
+				Vector r = position - m_positions[j];
+				Scalar r2 = glm::dot(r, r);
+				if (r2 >= h2 || r2 <= Scalar(0)) return;
+
+				Scalar distance = std::sqrt(r2);
+				Scalar inverseDensity = Scalar(1) / m_densities[j];
+				pressureForce -= r * (mass * (pressure + m_pressures[j]) * Scalar(0.5) * inverseDensity * kernel.gradient(distance) / distance);
+				viscosityForce += (m_velocities[j] - velocity) * (viscosity * mass * inverseDensity * kernel.laplacian(distance));
+			});
+
+			// params.force is a body acceleration such as gravity
+			m_forces[i] = pressureForce + viscosityForce + bodyForce * m_densities[i];
+		});
+	}
+
+	void kick(const FluidParams& params, const uint32_t* indices, size_t count, uint32_t tick)
+	{
+		const Scalar timeStep = static_cast<Scalar>(params.timeStep);
+
+		for (size_t k = 0; k < count; k++)
+		{
+			const size_t i = indices != nullptr ? indices[k] : k;
+
+			uint8_t level = chooseLevel(i, params, tick);
+			m_levelCounts[m_levels[i]]--;
+			m_levelCounts[level]++;
+			m_levels[i] = level;
+
+			m_velocities[i] += (timeStep / Scalar(1u << level)) * m_forces[i] / m_densities[i];
+		}
+	}
+
+	void drift(Scalar timeStep)
+	{
+		if (timeStep == Scalar(0)) return;
+
+		getWorkers().forRanges(m_positions.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				m_positions[i] += timeStep * m_velocities[i];
+			}
+		});
+	}
+
+	uint8_t chooseLevel(size_t i, const FluidParams& params, uint32_t tick) const
+	{
+		if (m_maxLevel == 0) return 0;
+
+		const Scalar h = static_cast<Scalar>(params.smoothingLength);
+		const Scalar timeStep = static_cast<Scalar>(params.timeStep);
+		const Scalar courant = static_cast<Scalar>(m_courantFactor);
+		Scalar allowed = timeStep;
+
+		Scalar speed = glm::length(m_velocities[i]);
+		if (speed > Scalar(0))
+		{
+			allowed = std::min(allowed, courant * h / speed);
+		}
+		Scalar acceleration = glm::length(m_forces[i]) / m_densities[i];
+		if (acceleration > Scalar(0))
+		{
+			allowed = std::min(allowed, courant * std::sqrt(h / acceleration));
+		}
+
+		uint32_t level = 0;
+		while (level < m_maxLevel && timeStep / Scalar(1u << level) > allowed)
+		{
+			level++;
+		}
+
+		// A coarser step may only start on one of its own boundaries
+		const uint32_t subTicks = 1u << m_maxLevel;
+		while (tick % (subTicks >> level) != 0)
+		{
+			level++;
+		}
+
+		return static_cast<uint8_t>(level);
+	}
+
+	void load(const std::vector<FluidParticle>& particles)
+	{
+		const size_t count = particles.size();
+		m_positions.resize(count);
+		m_velocities.resize(count);
+		m_forces.resize(count);
+		m_densities.resize(count);
+		m_pressures.resize(count);
+		m_neighbourCounts.resize(count);
+
+		getWorkers().forRanges(count, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				for (int axis = 0; axis < Dimensions; axis++)
+				{
+					m_positions[i][axis] = static_cast<Scalar>(particles[i].position[axis]);
+					m_velocities[i][axis] = static_cast<Scalar>(particles[i].velocity[axis]);
+					m_forces[i][axis] = static_cast<Scalar>(particles[i].force[axis]);
+				}
+				m_densities[i] = static_cast<Scalar>(particles[i].density);
+				m_pressures[i] = static_cast<Scalar>(particles[i].pressure);
+			}
+		});
+
+		if (m_levels.size() != count)
+		{
+			m_levels.assign(count, 0);
+			m_levelCounts.clear();
+		}
+		m_invalid = false;
+	}
+
+	// Axes beyond Dimensions are left untouched, a 2D fluid keeps its z
+	void store(std::vector<FluidParticle>& particles) const
+	{
+		getWorkers().forRanges(particles.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				for (int axis = 0; axis < Dimensions; axis++)
+				{
+					particles[i].position[axis] = static_cast<float>(m_positions[i][axis]);
+					particles[i].velocity[axis] = static_cast<float>(m_velocities[i][axis]);
+					particles[i].force[axis] = static_cast<float>(m_forces[i][axis]);
+				}
+				particles[i].density = static_cast<float>(m_densities[i]);
+				particles[i].pressure = static_cast<float>(m_pressures[i]);
+			}
+		});
+	}
+
+	bool m_invalid = true;
+
+	HugePageVector<Vector> m_positions;
+	HugePageVector<Vector> m_velocities;
+	HugePageVector<Vector> m_forces;
+	HugePageVector<Scalar> m_densities;
+	HugePageVector<Scalar> m_pressures;
+	HugePageVector<uint32_t> m_neighbourCounts;
+
+	FluidGrid<Dimensions, Scalar> m_grid;
+	FluidHashGrid<Dimensions, Scalar> m_hashGrid;
+	FluidIncrementalGrid<Dimensions, Scalar> m_incrementalGrid;
+
+	std::vector<uint8_t> m_levels;
+	std::vector<size_t> m_levelCounts;
+	std::vector<uint32_t> m_activeIndices;
+
+	mutable std::unique_ptr<WorkerPool> m_workers;
+	mutable uint32_t m_workersFirstCore = anyCore;
+
+	FluidPhaseTimer m_timer;
+};
@@ -0,0 +1,36 @@
+#include "FluidStatsLog.h"
+
+
+FluidStatsLog::FluidStatsLog(const std::string& filename) :
+	m_file(filename, std::ios::trunc)
+{
+	if (!m_file.is_open())
+	{
+		throw std::runtime_error("failed to open fluid stats log file");
+	}
+
+	m_file << "step,totalSeconds,gridSeconds,densitySeconds,forceSeconds,integrateSeconds,transferSeconds,pressureSeconds,"
+		"pressureIterations,particleUpdates,maxDensityError,meanDensityError,meanNeighbours,maxNeighbours,"
+		"cellsCount,occupiedCellsCount,meanParticlesPerCell,maxParticlesPerCell,gridMemoryUsage";
+	for (uint32_t bucket = 0; bucket < FluidSolverStats::histogramBuckets; bucket++)
+	{
+		m_file << ",neighbours" << bucket * FluidSolverStats::histogramBucketWidth;
+	}
+	m_file << '\n';
+}
+
+void FluidStatsLog::write(const FluidSolverStats& stats)
+{
+	m_file << stats.step << ',' << stats.totalSeconds << ',' << stats.gridSeconds << ',' << stats.densitySeconds << ','
+		<< stats.forceSeconds << ',' << stats.integrateSeconds << ',' << stats.transferSeconds << ',' << stats.pressureSeconds << ','
+		<< stats.pressureIterations << ',' << stats.particleUpdates << ','
+		<< stats.maxDensityError << ',' << stats.meanDensityError << ','
+		<< stats.meanNeighbours << ',' << stats.maxNeighbours << ','
+		<< stats.cellsCount << ',' << stats.occupiedCellsCount << ','
+		<< stats.meanParticlesPerCell << ',' << stats.maxParticlesPerCell << ',' << stats.gridMemoryUsage;
+	for (uint32_t bucket = 0; bucket < FluidSolverStats::histogramBuckets; bucket++)
+	{
+		m_file << ',' << stats.neighbourHistogram[bucket];
+	}
+	m_file << '\n';
+}
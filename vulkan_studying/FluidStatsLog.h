@@ -0,0 +1,15 @@
+#pragma once
+#include "FluidSolver.h"
+
+// Appends one CSV row of solver stats per step, the histogram as one column per bucket
+class FluidStatsLog
+{
+public:
+	explicit FluidStatsLog(const std::string& filename);
+
+	void write(const FluidSolverStats& stats);
+	void flush() { m_file.flush(); }
+
+private:
+	std::ofstream m_file;
+};
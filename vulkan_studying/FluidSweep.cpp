@@ -0,0 +1,161 @@
+#include "FluidSweep.h"
+#include "Parallel.h"
+
+#include <sstream>
+
+
+FluidSweep::FluidSweep(FluidParticle particle, uint32_t stepsCount) :
+	m_particle(particle),
+	m_stepsCount(stepsCount)
+{
+}
+
+void FluidSweep::addGrid(const FluidParams& base, const std::vector<float>& viscosities, const std::vector<float>& stiffnesses, const std::vector<float>& smoothingLengths)
+{
+	for (float smoothingLength : smoothingLengths)
+	{
+		for (float stiffness : stiffnesses)
+		{
+			for (float viscosity : viscosities)
+			{
+				FluidParams params = base;
+				params.particleViscosity = viscosity;
+				params.particleStiffness = stiffness;
+				params.smoothingLength = smoothingLength;
+				m_variants.push_back(params);
+			}
+		}
+	}
+}
+
+void FluidSweep::loadVariants(const std::string& filename, const FluidParams& base)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to open fluid sweep variants file");
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#') continue;
+
+		std::replace(line.begin(), line.end(), ',', ' ');
+		std::istringstream values(line);
+		FluidParams params = base;
+		if (!(values >> params.particleViscosity >> params.particleStiffness >> params.smoothingLength))
+		{
+			// A header line starts with a column name, anything else is a broken file
+			if (std::isalpha(static_cast<unsigned char>(line[0]))) continue;
+			throw std::runtime_error("malformed fluid sweep variant: " + line);
+		}
+		m_variants.push_back(params);
+	}
+}
+
+void FluidSweep::setSolver(uint32_t dimensions, FluidKernelType kernelType, FluidPrecision precision)
+{
+	// Fail here rather than on every worker
+	FluidSolver::create(dimensions, kernelType, precision);
+
+	m_dimensions = dimensions;
+	m_kernelType = kernelType;
+	m_precision = precision;
+}
+
+std::vector<FluidSweepResult> FluidSweep::run() const
+{
+	std::vector<FluidSweepResult> results(m_variants.size());
+	parallelFor(m_variants.size(), [&](size_t run)
+	{
+		results[run] = runVariant(run);
+	}, m_threadsCount);
+	return results;
+}
+
+FluidSweepResult FluidSweep::runVariant(size_t run) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	Fluid fluid(m_particle, m_variants[run]);
+	fluid.createSolver(m_dimensions, m_kernelType, m_precision);
+	fluid.getSolver().setGridType(m_gridType);
+	fluid.getSolver().setMaxTimeStepLevel(m_maxLevel);
+
+	FluidSweepResult result = {};
+	result.run = run;
+	result.params = m_variants[run];
+
+	// Only steps that left every particle finite count, the one a run diverges in does not
+	while (result.stepsDone < m_stepsCount && !result.diverged)
+	{
+		// An exploding variant can outgrow the neighbour grid before it turns non finite,
+		// that only ends this run and not the whole sweep
+		try
+		{
+			fluid.update();
+		}
+		catch (const std::exception&)
+		{
+			result.diverged = true;
+			break;
+		}
+
+		for (const auto& particle : fluid.getParticles())
+		{
+			if (!std::isfinite(particle.position.x + particle.position.y + particle.position.z +
+				particle.velocity.x + particle.velocity.y + particle.velocity.z))
+			{
+				result.diverged = true;
+				break;
+			}
+		}
+		if (!result.diverged)
+		{
+			result.stepsDone++;
+		}
+	}
+
+	const auto& particles = fluid.getParticles();
+	const FluidParams& params = fluid.getParams();
+	double density = 0.0;
+	glm::dvec3 center(0.0);
+	for (const auto& particle : particles)
+	{
+		density += particle.density;
+		center += glm::dvec3(particle.position);
+		result.maxDensityError = std::max(result.maxDensityError, std::abs(particle.density - params.particleRestingDensity) / params.particleRestingDensity);
+		result.maxSpeed = std::max(result.maxSpeed, glm::length(particle.velocity));
+		result.kineticEnergy += 0.5f * params.particleMass * glm::dot(particle.velocity, particle.velocity);
+	}
+	if (!particles.empty())
+	{
+		result.meanDensity = static_cast<float>(density / particles.size());
+		result.centerOfMass = glm::vec3(center / static_cast<double>(particles.size()));
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	return result;
+}
+
+void FluidSweep::writeCsv(const std::string& filename, const std::vector<FluidSweepResult>& results)
+{
+	std::ofstream file(filename, std::ios::trunc);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to open fluid sweep results file");
+	}
+
+	file << "run,particlesCount,viscosity,stiffness,smoothingLength,timeStep,steps,diverged,seconds,"
+		"meanDensity,maxDensityError,maxSpeed,kineticEnergy,centerX,centerY,centerZ\n";
+	for (const auto& result : results)
+	{
+		file << result.run << ',' << result.params.particlesCount << ','
+			<< result.params.particleViscosity << ',' << result.params.particleStiffness << ','
+			<< result.params.smoothingLength << ',' << result.params.timeStep << ','
+			<< result.stepsDone << ',' << (result.diverged ? 1 : 0) << ',' << result.seconds << ','
+			<< result.meanDensity << ',' << result.maxDensityError << ',' << result.maxSpeed << ','
+			<< result.kineticEnergy << ',' << result.centerOfMass.x << ',' << result.centerOfMass.y << ',' << result.centerOfMass.z << '\n';
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "Fluid.h"
+#include "FluidSolver.h"
+
+// Summary of one finished sweep run
+struct FluidSweepResult
+{
+	size_t run;
+	FluidParams params;
+	uint32_t stepsDone;// steps completed before the run diverged, if it did
+	bool diverged;// a position or velocity went non finite, the run stopped there
+	double seconds;
+	float meanDensity;
+	float maxDensityError;// max |density - rest| / rest over the final frame
+	float maxSpeed;
+	float kineticEnergy;
+	glm::vec3 centerOfMass;
+};
+
+// Runs many small independent Fluid simulations headless, one per FluidParams variant, spread over all cores.
+// Every run gets its own Fluid and solver, so runs share nothing and scale with the number of cores
+class FluidSweep
+{
+public:
+	FluidSweep(FluidParticle particle, uint32_t stepsCount);
+
+	void addVariant(const FluidParams& params) { m_variants.push_back(params); }
+	// Every combination of the given values on top of base, viscosity varying fastest
+	void addGrid(const FluidParams& base, const std::vector<float>& viscosities, const std::vector<float>& stiffnesses, const std::vector<float>& smoothingLengths);
+	// CSV with particleViscosity,particleStiffness,smoothingLength per line on top of base; '#' lines and a header line are skipped
+	void loadVariants(const std::string& filename, const FluidParams& base);
+
+	void setThreadsCount(uint32_t threadsCount) { m_threadsCount = threadsCount; }
+	void setSolver(uint32_t dimensions, FluidKernelType kernelType, FluidPrecision precision);
+	void setGridType(FluidGridType gridType) { m_gridType = gridType; }
+	void setMaxTimeStepLevel(uint32_t maxLevel) { m_maxLevel = maxLevel; }
+
+	// Results come back in variant order regardless of which thread ran them
+	std::vector<FluidSweepResult> run() const;
+
+	static void writeCsv(const std::string& filename, const std::vector<FluidSweepResult>& results);
+
+	size_t getVariantsCount() const { return m_variants.size(); }
+
+private:
+	FluidSweepResult runVariant(size_t run) const;
+
+	FluidParticle m_particle;
+	uint32_t m_stepsCount;
+	std::vector<FluidParams> m_variants;
+
+	uint32_t m_threadsCount = 0;
+	uint32_t m_dimensions = 3;
+	FluidKernelType m_kernelType = FluidKernelType::Poly6Spiky;
+	FluidPrecision m_precision = FluidPrecision::Single;
+	FluidGridType m_gridType = FluidGridType::Dense;
+	uint32_t m_maxLevel = 0;
+};
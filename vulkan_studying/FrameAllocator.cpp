@@ -0,0 +1,85 @@
+#include "FrameAllocator.h"
+
+
+namespace
+{
+	const size_t cacheLineSize = 64;
+
+	VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+void FrameAllocator::init(uint32_t framesCount, VkDeviceSize gpuFrameSize, size_t hostFrameSize, VkBufferUsageFlags usage)
+{
+	const VkPhysicalDeviceLimits& limits = m_device.getPhysicalDeviceProperties().limits;
+	m_uniformAlignment = std::max<VkDeviceSize>(limits.minUniformBufferOffsetAlignment, 1);
+	m_storageAlignment = std::max<VkDeviceSize>(limits.minStorageBufferOffsetAlignment, 1);
+
+	// Every frame range starts where any kind of binding and a non-coherent flush may start
+	VkDeviceSize frameAlignment = std::max(std::max(m_uniformAlignment, m_storageAlignment), std::max<VkDeviceSize>(limits.nonCoherentAtomSize, 1));
+	m_gpuFrameSize = alignUp(gpuFrameSize, frameAlignment);
+	m_framesCount = framesCount;
+
+	// Device-local memory the CPU can write (resizable BAR) saves the shaders a trip over the bus
+	VkMemoryPropertyFlags propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	if (m_device.hasMemoryType(propertyFlags | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+	{
+		propertyFlags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	}
+	m_device.createBuffer(m_gpuFrameSize * framesCount, usage, propertyFlags, m_buffer, m_allocation);
+	GpuAllocation allocation = m_allocation;
+	m_mapped = static_cast<uint8_t*>(allocation->mapped);
+
+	m_hostFrameSize = static_cast<size_t>(alignUp(hostFrameSize, cacheLineSize));
+	m_hostMemory.reset(new uint8_t[m_hostFrameSize * framesCount + cacheLineSize]);
+	m_host = reinterpret_cast<uint8_t*>(static_cast<uintptr_t>(alignUp(reinterpret_cast<uintptr_t>(m_hostMemory.get()), cacheLineSize)));
+
+	m_frame = 0;
+	m_gpuOffset = 0;
+	m_hostOffset = 0;
+}
+
+void FrameAllocator::beginFrame(uint32_t frame)
+{
+	assert(frame < m_framesCount);
+	m_frame = frame;
+	m_gpuOffset = 0;
+	m_hostOffset = 0;
+}
+
+FrameAllocation FrameAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	VkDeviceSize offset = alignUp(m_gpuOffset, std::max<VkDeviceSize>(alignment, 1));
+	if (offset + size > m_gpuFrameSize)
+	{
+		throw std::runtime_error("frame allocator ran out of gpu memory");
+	}
+	m_gpuOffset = offset + size;
+
+	FrameAllocation allocation;
+	allocation.buffer = m_buffer;
+	allocation.offset = getFrameOffset(m_frame) + offset;
+	allocation.mapped = m_mapped + allocation.offset;
+	return allocation;
+}
+
+void* FrameAllocator::allocateHost(size_t size, size_t alignment)
+{
+	size_t offset = static_cast<size_t>(alignUp(m_hostOffset, std::max<size_t>(alignment, 1)));
+	if (offset + size > m_hostFrameSize)
+	{
+		throw std::runtime_error("frame allocator ran out of host memory");
+	}
+	m_hostOffset = offset + size;
+	return m_host + m_hostFrameSize * m_frame + offset;
+}
+
+void FrameAllocator::flush()
+{
+	if (m_gpuOffset > 0)
+	{
+		m_device.getAllocator().flush(m_allocation, getFrameOffset(m_frame), m_gpuOffset);
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "Device.h"
+#include <memory>
+
+// Transient GPU memory handed out by FrameAllocator, valid until the same frame slot begins again
+struct FrameAllocation
+{
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	void* mapped;
+};
+
+// Bump allocators for data that lives one frame: per frame slot a range of one persistently mapped buffer and a
+// host arena. Allocating moves an offset, beginning a frame sets both offsets back to zero, nothing is ever freed
+// one by one. A slot must only begin again once the fence of its previous frame has signalled
+class FrameAllocator
+{
+public:
+	// Transient vertex, index, uniform, storage and indirect data all fit the one buffer
+	static const VkBufferUsageFlags defaultUsage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+
+	explicit FrameAllocator(Device& device) : m_device(device) {}
+
+	FrameAllocator(const FrameAllocator&) = delete;
+	FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+	// Calling it again replaces the buffer, the device must be idle then
+	void init(uint32_t framesCount, VkDeviceSize gpuFrameSize, size_t hostFrameSize, VkBufferUsageFlags usage = defaultUsage);
+
+	void beginFrame(uint32_t frame);
+	// Throws when the frame's range is used up
+	FrameAllocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+	FrameAllocation allocateUniform(VkDeviceSize size) { return allocate(size, m_uniformAlignment); }
+	FrameAllocation allocateStorage(VkDeviceSize size) { return allocate(size, m_storageAlignment); }
+	void* allocateHost(size_t size, size_t alignment = 16);
+	template<typename T>
+	T* allocateHost(size_t count) { return static_cast<T*>(allocateHost(sizeof(T) * count, alignof(T))); }
+	// Makes this frame's writes visible to the GPU when the memory isn't host coherent; call before submitting
+	void flush();
+
+	VkBuffer getBuffer() const { return m_buffer; }
+	uint32_t getFramesCount() const { return m_framesCount; }
+	// Where a frame's range starts in the buffer, which is also where its first allocation goes
+	VkDeviceSize getFrameOffset(uint32_t frame) const { return m_gpuFrameSize * frame; }
+	VkDeviceSize getGpuUsed() const { return m_gpuOffset; }
+	size_t getHostUsed() const { return m_hostOffset; }
+
+private:
+	Device& m_device;
+
+	DeviceCleaner<VkBuffer, vkDestroyBuffer> m_buffer;
+	RootCleaner<GpuAllocation, freeGpuAllocation> m_allocation;
+	uint8_t* m_mapped = nullptr;
+	VkDeviceSize m_gpuFrameSize = 0;
+	VkDeviceSize m_gpuOffset = 0;
+	VkDeviceSize m_uniformAlignment = 1;
+	VkDeviceSize m_storageAlignment = 1;
+
+	std::unique_ptr<uint8_t[]> m_hostMemory;
+	uint8_t* m_host = nullptr;// m_hostMemory aligned to a cache line
+	size_t m_hostFrameSize = 0;
+	size_t m_hostOffset = 0;
+
+	uint32_t m_framesCount = 0;
+	uint32_t m_frame = 0;
+};
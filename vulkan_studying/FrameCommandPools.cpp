@@ -0,0 +1,78 @@
+#include "FrameCommandPools.h"
+
+
+FrameCommandPools::~FrameCommandPools()
+{
+	destroy();
+}
+
+void FrameCommandPools::init(uint32_t queueFamilyIndex, uint32_t framesCount, uint32_t threadsCount)
+{
+	destroy();
+
+	m_queueFamilyIndex = queueFamilyIndex;
+	m_framesCount = framesCount;
+	m_threadsCount = std::max(threadsCount, 1u);
+	m_frame = 0;
+
+	// Buffers live one frame and are only ever reset with their pool
+	m_pools.resize(m_framesCount * m_threadsCount);
+	for (auto& pool : m_pools)
+	{
+		pool.commandPool = m_device.createCommandPool(queueFamilyIndex, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+	}
+}
+
+void FrameCommandPools::destroy()
+{
+	// Destroying a command pool frees its buffers
+	for (auto& pool : m_pools)
+	{
+		vkDestroyCommandPool(m_device.getLogicalDevice(), pool.commandPool, nullptr);
+	}
+	m_pools.clear();
+}
+
+void FrameCommandPools::beginFrame(uint32_t frame)
+{
+	assert(frame < m_framesCount);
+	m_frame = frame;
+	for (uint32_t thread = 0; thread < m_threadsCount; thread++)
+	{
+		Pool& pool = m_pools[frame * m_threadsCount + thread];
+		if (pool.used[0] + pool.used[1] == 0)
+		{
+			continue;
+		}
+		if (vkResetCommandPool(m_device.getLogicalDevice(), pool.commandPool, 0) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to reset command pool");
+		}
+		pool.used[0] = 0;
+		pool.used[1] = 0;
+	}
+}
+
+VkCommandBuffer FrameCommandPools::allocate(uint32_t thread, VkCommandBufferLevel level)
+{
+	assert(thread < m_threadsCount);
+	Pool& pool = m_pools[m_frame * m_threadsCount + thread];
+	std::vector<VkCommandBuffer>& buffers = pool.buffers[level];
+	size_t& used = pool.used[level];
+	if (used == buffers.size())
+	{
+		VkCommandBufferAllocateInfo allocateInfo = {};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocateInfo.commandPool = pool.commandPool;
+		allocateInfo.level = level;
+		allocateInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_device.getLogicalDevice(), &allocateInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate command buffers");
+		}
+		buffers.push_back(commandBuffer);
+	}
+	return buffers[used++];
+}
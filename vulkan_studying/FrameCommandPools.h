@@ -0,0 +1,46 @@
+#pragma once
+#include "Device.h"
+
+// One transient command pool per recording thread and frame in flight. Beginning a frame resets all of its pools
+// with one vkResetCommandPool each, which puts every buffer they handed out back in the initial state at once;
+// the buffers are kept and handed out again, so steady-state frames allocate nothing.
+// Thread indices are slots, not OS threads: each one may only be used by one thread at a time
+class FrameCommandPools
+{
+public:
+	explicit FrameCommandPools(Device& device) : m_device(device) {}
+	~FrameCommandPools();
+
+	FrameCommandPools(const FrameCommandPools&) = delete;
+	FrameCommandPools& operator=(const FrameCommandPools&) = delete;
+
+	// Calling it again replaces the pools, none of their buffers may be pending then
+	void init(uint32_t queueFamilyIndex, uint32_t framesCount, uint32_t threadsCount);
+	void destroy();
+
+	// The fence of the frame's previous submission must have signalled
+	void beginFrame(uint32_t frame);
+	// A buffer of the current frame's pool for thread, ready to begin; valid until the frame begins again
+	VkCommandBuffer allocate(uint32_t thread, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+	uint32_t getQueueFamilyIndex() const { return m_queueFamilyIndex; }
+	uint32_t getFramesCount() const { return m_framesCount; }
+	uint32_t getThreadsCount() const { return m_threadsCount; }
+
+private:
+	struct Pool
+	{
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		// Per level, the first used ones of buffers have been handed out since the last reset
+		std::vector<VkCommandBuffer> buffers[2];
+		size_t used[2] = {};
+	};
+
+	Device& m_device;
+
+	std::vector<Pool> m_pools;// frame * m_threadsCount + thread
+	uint32_t m_queueFamilyIndex = 0;
+	uint32_t m_framesCount = 0;
+	uint32_t m_threadsCount = 0;
+	uint32_t m_frame = 0;
+};
@@ -0,0 +1,331 @@
+#include "GpuAllocator.h"
+
+
+VKAPI_ATTR void VKAPI_CALL freeGpuAllocation(GpuAllocation allocation, const VkAllocationCallbacks*)
+{
+	if (allocation != nullptr)
+	{
+		allocation->allocator->free(allocation);
+	}
+}
+
+GpuAllocator::~GpuAllocator()
+{
+	destroy();
+}
+
+void GpuAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize preferredBlockSize)
+{
+	m_device = device;
+	m_preferredBlockSize = preferredBlockSize;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+}
+
+void GpuAllocator::destroy()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (uint32_t memoryType = 0; memoryType < VK_MAX_MEMORY_TYPES; memoryType++)
+	{
+		for (auto& block : m_blocks[memoryType])
+		{
+			vkFreeMemory(m_device, block->memory, nullptr);
+		}
+		m_blocks[memoryType].clear();
+	}
+}
+
+GpuAllocation GpuAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags propertyFlags)
+{
+	const uint32_t memoryType = getMemoryType(requirements.memoryTypeBits, propertyFlags);
+	const VkDeviceSize blockSize = getBlockSize(memoryType);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Block* block = nullptr;
+	TlsfAllocator::Allocation range = {};
+	if (requirements.size > blockSize / 2)
+	{
+		block = createBlock(memoryType, requirements.size, true);
+		block->ranges->allocate(requirements.size, 1, range);
+	}
+	else
+	{
+		for (auto& candidate : m_blocks[memoryType])
+		{
+			if (!candidate->dedicated && candidate->ranges->getFreeSize() >= requirements.size &&
+				candidate->ranges->allocate(requirements.size, requirements.alignment, range))
+			{
+				block = candidate.get();
+				break;
+			}
+		}
+
+		if (block == nullptr)
+		{
+			block = createBlock(memoryType, blockSize, false);
+			if (!block->ranges->allocate(requirements.size, requirements.alignment, range))
+			{
+				throw std::runtime_error("failed to suballocate gpu memory");
+			}
+		}
+	}
+
+	return createAllocation(block, memoryType, requirements.size, range);
+}
+
+float GpuAllocator::getBlockUsage(GpuAllocation allocation) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const Block* block = static_cast<const Block*>(allocation->block);
+	return block->dedicated ? 1.0f : getUsage(*block);
+}
+
+GpuAllocation GpuAllocator::allocateForMove(const VkMemoryRequirements& requirements, GpuAllocation source)
+{
+	if ((requirements.memoryTypeBits & (1u << source->memoryType)) == 0)
+	{
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const Block* sourceBlock = static_cast<const Block*>(source->block);
+	const float sourceUsage = getUsage(*sourceBlock);
+
+	// Fullest blocks first, so the moved data packs into as few blocks as possible
+	std::vector<Block*> candidates;
+	for (auto& block : m_blocks[source->memoryType])
+	{
+		if (block.get() != sourceBlock && !block->dedicated && getUsage(*block) >= sourceUsage && block->ranges->getFreeSize() >= requirements.size)
+		{
+			candidates.push_back(block.get());
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const Block* left, const Block* right) { return getUsage(*left) > getUsage(*right); });
+
+	for (Block* block : candidates)
+	{
+		TlsfAllocator::Allocation range = {};
+		if (block->ranges->allocate(requirements.size, requirements.alignment, range))
+		{
+			return createAllocation(block, source->memoryType, requirements.size, range);
+		}
+	}
+	return nullptr;
+}
+
+void GpuAllocator::free(GpuAllocation allocation)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Block* block = static_cast<Block*>(allocation->block);
+	block->ranges->free(allocation->chunk);
+	m_allocationsCount--;
+
+	// Keep one empty shared block per memory type around, so a buffer recreated every frame doesn't churn blocks
+	if (block->ranges->isEmpty())
+	{
+		bool keep = !block->dedicated;
+		if (keep)
+		{
+			for (auto& other : m_blocks[allocation->memoryType])
+			{
+				if (other.get() != block && !other->dedicated && other->ranges->isEmpty())
+				{
+					keep = false;
+					break;
+				}
+			}
+		}
+		if (!keep)
+		{
+			destroyBlock(allocation->memoryType, block);
+		}
+	}
+
+	delete allocation;
+}
+
+void GpuAllocator::flush(GpuAllocation allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (m_memoryProperties.memoryTypes[allocation->memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+	{
+		return;
+	}
+
+	// Flushed ranges have to start and end on nonCoherentAtomSize, blocks are allocated in multiples of it
+	const Block* block = static_cast<const Block*>(allocation->block);
+	if (size == VK_WHOLE_SIZE)
+	{
+		size = allocation->size - offset;
+	}
+	VkDeviceSize begin = (allocation->offset + offset) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+	VkDeviceSize end = std::min(block->size, (allocation->offset + offset + size + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize);
+
+	VkMappedMemoryRange mappedRange = {};
+	mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	mappedRange.memory = allocation->memory;
+	mappedRange.offset = begin;
+	mappedRange.size = end - begin;
+	if (vkFlushMappedMemoryRanges(m_device, 1, &mappedRange) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to flush mapped memory");
+	}
+}
+
+uint32_t GpuAllocator::getBlocksCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	uint32_t count = 0;
+	for (const auto& blocks : m_blocks)
+	{
+		count += static_cast<uint32_t>(blocks.size());
+	}
+	return count;
+}
+
+uint32_t GpuAllocator::getAllocationsCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_allocationsCount;
+}
+
+GpuMemoryStats GpuAllocator::getStats() const
+{
+	GpuMemoryStats stats = {};
+	stats.types.resize(m_memoryProperties.memoryTypeCount);
+	stats.heaps.resize(m_memoryProperties.memoryHeapCount);
+	std::vector<VkDeviceSize> typeFreeBytes(stats.types.size(), 0);
+	std::vector<VkDeviceSize> heapFreeBytes(stats.heaps.size(), 0);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (uint32_t heapIndex = 0; heapIndex < m_memoryProperties.memoryHeapCount; heapIndex++)
+	{
+		stats.heaps[heapIndex].size = m_memoryProperties.memoryHeaps[heapIndex].size;
+		stats.heaps[heapIndex].flags = m_memoryProperties.memoryHeaps[heapIndex].flags;
+	}
+
+	for (uint32_t memoryType = 0; memoryType < m_memoryProperties.memoryTypeCount; memoryType++)
+	{
+		GpuMemoryTypeStats& type = stats.types[memoryType];
+		type.heapIndex = m_memoryProperties.memoryTypes[memoryType].heapIndex;
+		type.propertyFlags = m_memoryProperties.memoryTypes[memoryType].propertyFlags;
+		GpuMemoryUsage& heap = stats.heaps[type.heapIndex].usage;
+
+		for (const auto& block : m_blocks[memoryType])
+		{
+			const TlsfAllocator& ranges = *block->ranges;
+			for (GpuMemoryUsage* usage : { &type.usage, &heap })
+			{
+				usage->blocksCount++;
+				usage->allocationsCount += ranges.getAllocationsCount();
+				usage->allocatedBytes += block->size;
+				usage->usedBytes += block->size - ranges.getFreeSize();
+				usage->largestFreeRange = std::max<VkDeviceSize>(usage->largestFreeRange, ranges.getLargestFreeSize());
+			}
+			typeFreeBytes[memoryType] += ranges.getFreeSize();
+			heapFreeBytes[type.heapIndex] += ranges.getFreeSize();
+		}
+	}
+
+	for (size_t i = 0; i < stats.types.size(); i++)
+	{
+		GpuMemoryUsage& usage = stats.types[i].usage;
+		usage.fragmentation = typeFreeBytes[i] > 0 ? 1.0f - static_cast<float>(usage.largestFreeRange) / typeFreeBytes[i] : 0.0f;
+	}
+	for (size_t i = 0; i < stats.heaps.size(); i++)
+	{
+		GpuMemoryUsage& usage = stats.heaps[i].usage;
+		usage.fragmentation = heapFreeBytes[i] > 0 ? 1.0f - static_cast<float>(usage.largestFreeRange) / heapFreeBytes[i] : 0.0f;
+	}
+	return stats;
+}
+
+GpuAllocation GpuAllocator::createAllocation(Block* block, uint32_t memoryType, VkDeviceSize size, const TlsfAllocator::Allocation& range)
+{
+	GpuAllocation allocation = new GpuAllocation_T();
+	allocation->memory = block->memory;
+	allocation->offset = range.offset;
+	allocation->size = size;
+	allocation->memoryType = memoryType;
+	allocation->mapped = block->mapped != nullptr ? static_cast<uint8_t*>(block->mapped) + range.offset : nullptr;
+	allocation->allocator = this;
+	allocation->block = block;
+	allocation->chunk = range.chunk;
+	m_allocationsCount++;
+	return allocation;
+}
+
+float GpuAllocator::getUsage(const Block& block)
+{
+	return 1.0f - static_cast<float>(block.ranges->getFreeSize()) / block.size;
+}
+
+uint32_t GpuAllocator::getMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags) const
+{
+	for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++)
+	{
+		if ((typeFilter & (1 << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & propertyFlags) == propertyFlags)
+		{
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type");
+}
+
+VkDeviceSize GpuAllocator::getBlockSize(uint32_t memoryType) const
+{
+	const VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[memoryType].heapIndex].size;
+	VkDeviceSize blockSize = heapSize <= (VkDeviceSize(1) << 30) ? heapSize / 8 : m_preferredBlockSize;
+	return (blockSize + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+}
+
+GpuAllocator::Block* GpuAllocator::createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated)
+{
+	size = (size + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+
+	VkMemoryAllocateInfo memoryAllocateInfo = {};
+	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocateInfo.allocationSize = size;
+	memoryAllocateInfo.memoryTypeIndex = memoryType;
+
+	std::unique_ptr<Block> block(new Block());
+	if (vkAllocateMemory(m_device, &memoryAllocateInfo, nullptr, &block->memory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate gpu memory block");
+	}
+	block->size = size;
+	block->mapped = nullptr;
+	block->dedicated = dedicated;
+	block->ranges.reset(new TlsfAllocator(size));
+
+	if (m_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		if (vkMapMemory(m_device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS)
+		{
+			vkFreeMemory(m_device, block->memory, nullptr);
+			throw std::runtime_error("failed to map gpu memory block");
+		}
+	}
+
+	m_blocks[memoryType].push_back(std::move(block));
+	return m_blocks[memoryType].back().get();
+}
+
+void GpuAllocator::destroyBlock(uint32_t memoryType, Block* block)
+{
+	auto& blocks = m_blocks[memoryType];
+	for (auto it = blocks.begin(); it != blocks.end(); ++it)
+	{
+		if (it->get() == block)
+		{
+			vkFreeMemory(m_device, block->memory, nullptr);
+			blocks.erase(it);
+			return;
+		}
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include "Headers.h"
+#include "TlsfAllocator.h"
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <mutex>
+
+class GpuAllocator;
+
+// One suballocated range, handed around as a pointer like the Vulkan handles so Cleaner can own it
+struct GpuAllocation_T
+{
+	VkDeviceMemory memory;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	uint32_t memoryType;
+	void* mapped;// host visible memory stays mapped for its whole life, nullptr otherwise
+
+	GpuAllocator* allocator;
+	void* block;
+	uint32_t chunk;
+};
+typedef GpuAllocation_T* GpuAllocation;
+
+// Usage of one memory type or heap; allocated bytes are what the blocks took from the driver, used bytes what was handed out
+struct GpuMemoryUsage
+{
+	uint32_t blocksCount;
+	uint32_t allocationsCount;
+	VkDeviceSize allocatedBytes;
+	VkDeviceSize usedBytes;
+	VkDeviceSize largestFreeRange;
+	// 1 - largest free range / free bytes: 0 when the free space is one range, near 1 when it is scattered in small holes
+	float fragmentation;
+};
+
+struct GpuMemoryTypeStats
+{
+	uint32_t heapIndex;
+	VkMemoryPropertyFlags propertyFlags;
+	GpuMemoryUsage usage;
+};
+
+struct GpuMemoryHeapStats
+{
+	VkDeviceSize size;
+	VkMemoryHeapFlags flags;
+	GpuMemoryUsage usage;
+	// Driver figures from VK_EXT_memory_budget for the whole process, 0 when the extension isn't there
+	VkDeviceSize budget;
+	VkDeviceSize processUsage;
+};
+
+struct GpuMemoryStats
+{
+	std::vector<GpuMemoryTypeStats> types;
+	std::vector<GpuMemoryHeapStats> heaps;
+	bool hasBudget;
+};
+
+// Cleaner-compatible counterpart of vkFreeMemory
+VKAPI_ATTR void VKAPI_CALL freeGpuAllocation(GpuAllocation allocation, const VkAllocationCallbacks* allocator = nullptr);
+
+// Hands out device memory from a few large blocks per memory type instead of one vkAllocateMemory per resource,
+// which keeps far below maxMemoryAllocationCount and avoids a driver round trip per buffer.
+// Blocks are split with a TlsfAllocator; requests bigger than half a block get a block of their own
+class GpuAllocator
+{
+public:
+	GpuAllocator() {}
+	~GpuAllocator();
+
+	GpuAllocator(const GpuAllocator&) = delete;
+	GpuAllocator& operator=(const GpuAllocator&) = delete;
+
+	// Block size is preferredBlockSize, or an eighth of the heap for heaps of 1 GB or less
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize preferredBlockSize = VkDeviceSize(64) << 20);
+	// Frees every block, the device must outlive this
+	void destroy();
+
+	GpuAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags propertyFlags);
+	void free(GpuAllocation allocation);
+
+	// Share of the allocation's block in use, 1 for dedicated blocks since those never get any emptier
+	float getBlockUsage(GpuAllocation allocation) const;
+	// Room for a moved copy of source in another shared block of its type that is at least as full, never a new block;
+	// nullptr when there is none
+	GpuAllocation allocateForMove(const VkMemoryRequirements& requirements, GpuAllocation source);
+
+	// Makes host writes visible when the memory type is not host coherent, a no-op otherwise
+	void flush(GpuAllocation allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+	uint32_t getBlocksCount() const;
+	uint32_t getAllocationsCount() const;
+	// Snapshot of every memory type and heap; budget fields are left for the caller
+	GpuMemoryStats getStats() const;
+
+private:
+	struct Block
+	{
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		void* mapped;
+		bool dedicated;
+		std::unique_ptr<TlsfAllocator> ranges;
+	};
+
+	GpuAllocation createAllocation(Block* block, uint32_t memoryType, VkDeviceSize size, const TlsfAllocator::Allocation& range);
+	static float getUsage(const Block& block);
+	uint32_t getMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags) const;
+	VkDeviceSize getBlockSize(uint32_t memoryType) const;
+	Block* createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated);
+	void destroyBlock(uint32_t memoryType, Block* block);
+
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties m_memoryProperties = {};
+	VkDeviceSize m_nonCoherentAtomSize = 1;
+	VkDeviceSize m_preferredBlockSize = 0;
+
+	std::vector<std::unique_ptr<Block>> m_blocks[VK_MAX_MEMORY_TYPES];
+	uint32_t m_allocationsCount = 0;
+
+	mutable std::mutex m_mutex;
+};
@@ -0,0 +1,218 @@
+#include "GpuDefragmenter.h"
+#include <map>
+#include <memory>
+
+
+GpuDefragmenter::~GpuDefragmenter()
+{
+	destroy();
+}
+
+void GpuDefragmenter::init(VkQueue queue, uint32_t queueFamilyIndex, DeletionQueue* deletionQueue)
+{
+	m_deletionQueue = deletionQueue;
+	// Moves are buffer to buffer, nothing is staged
+	m_copies.init(queue, queueFamilyIndex, 0);
+}
+
+void GpuDefragmenter::destroy()
+{
+	// Unfinished moves are dropped, their owners keep the buffers they have
+	while (!m_moves.empty())
+	{
+		cancelMove(m_moves.back());
+		m_moves.pop_back();
+	}
+	m_copies.destroy();
+	m_entries.clear();
+}
+
+void GpuDefragmenter::track(DeviceCleaner<VkBuffer, vkDestroyBuffer>& buffer, RootCleaner<GpuAllocation, freeGpuAllocation>& allocation, VkDeviceSize size, VkBufferUsageFlags usage, MovedCallback onMoved)
+{
+	if ((usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) == 0)
+	{
+		throw std::runtime_error("defragmented buffers need transfer source usage");
+	}
+
+	Entry entry;
+	entry.buffer = std::addressof(buffer);
+	entry.allocation = std::addressof(allocation);
+	entry.size = size;
+	entry.usage = usage;
+	entry.onMoved = onMoved;
+	entry.moving = false;
+	m_entries.push_back(entry);
+}
+
+void GpuDefragmenter::untrack(DeviceCleaner<VkBuffer, vkDestroyBuffer>& buffer)
+{
+	for (auto entry = m_entries.begin(); entry != m_entries.end(); ++entry)
+	{
+		if (entry->buffer != std::addressof(buffer))
+		{
+			continue;
+		}
+
+		for (auto move = m_moves.begin(); move != m_moves.end(); ++move)
+		{
+			if (move->entry == &*entry)
+			{
+				cancelMove(*move);
+				m_moves.erase(move);
+				break;
+			}
+		}
+		m_entries.erase(entry);
+		return;
+	}
+}
+
+void GpuDefragmenter::step(VkDeviceSize maxBytes)
+{
+	finishMoves();
+
+	// The first move always goes, so a buffer bigger than the budget still gets its turn
+	VkDeviceSize bytes = 0;
+	for (Entry* entry : findSparseBlock())
+	{
+		if (bytes > 0 && bytes + entry->size > maxBytes)
+		{
+			break;
+		}
+		if (!startMove(*entry))
+		{
+			// The other blocks are too full for it, try again once the allocations have changed
+			m_stuckBlock = static_cast<GpuAllocation>(*entry->allocation)->block;
+			m_stuckAllocationsCount = m_device.getAllocator().getAllocationsCount();
+			break;
+		}
+		bytes += entry->size;
+	}
+
+	if (bytes > 0)
+	{
+		m_copies.flush();
+	}
+}
+
+void GpuDefragmenter::finishMoves()
+{
+	for (size_t i = 0; i < m_moves.size();)
+	{
+		Move& move = m_moves[i];
+		if (!m_copies.isComplete(move.ticket))
+		{
+			i++;
+			continue;
+		}
+
+		Entry& entry = *move.entry;
+		std::function<void()> destroyBuffer = entry.buffer->detach();
+		std::function<void()> freeAllocation = entry.allocation->detach();
+		entry.buffer->reset(m_device.getLogicalDevice(), move.buffer);
+		entry.allocation->reset(move.allocation);
+		entry.moving = false;
+		m_movesCount++;
+		m_movedBytes += entry.size;
+
+		entry.onMoved(move.buffer);
+		if (m_deletionQueue != nullptr)
+		{
+			m_deletionQueue->retire(destroyBuffer);
+			m_deletionQueue->retire(freeAllocation);
+		}
+		else
+		{
+			destroyBuffer();
+			freeAllocation();
+		}
+
+		m_moves.erase(m_moves.begin() + i);
+	}
+}
+
+void GpuDefragmenter::cancelMove(Move& move)
+{
+	m_copies.wait(move.ticket);
+	vkDestroyBuffer(m_device.getLogicalDevice(), move.buffer, nullptr);
+	freeGpuAllocation(move.allocation);
+	move.entry->moving = false;
+}
+
+std::vector<GpuDefragmenter::Entry*> GpuDefragmenter::findSparseBlock()
+{
+	GpuAllocator& allocator = m_device.getAllocator();
+	if (m_stuckBlock != nullptr && allocator.getAllocationsCount() != m_stuckAllocationsCount)
+	{
+		m_stuckBlock = nullptr;
+	}
+
+	std::map<void*, std::vector<Entry*>> blocks;
+	void* sparsest = nullptr;
+	float sparsestUsage = m_usageThreshold;
+	for (auto& entry : m_entries)
+	{
+		GpuAllocation allocation = *entry.allocation;
+		if (entry.moving || allocation == nullptr || allocation->block == m_stuckBlock)
+		{
+			continue;
+		}
+
+		float usage = allocator.getBlockUsage(allocation);
+		if (usage < m_usageThreshold)
+		{
+			blocks[allocation->block].push_back(&entry);
+			if (usage < sparsestUsage)
+			{
+				sparsest = allocation->block;
+				sparsestUsage = usage;
+			}
+		}
+	}
+
+	if (sparsest == nullptr)
+	{
+		return std::vector<Entry*>();
+	}
+	return blocks[sparsest];
+}
+
+bool GpuDefragmenter::startMove(Entry& entry)
+{
+	VkBufferCreateInfo bufferCreateInfo = {};
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.size = entry.size;
+	bufferCreateInfo.usage = entry.usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkBuffer buffer;
+	if (vkCreateBuffer(m_device.getLogicalDevice(), &bufferCreateInfo, nullptr, &buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create buffer");
+	}
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetBufferMemoryRequirements(m_device.getLogicalDevice(), buffer, &memoryRequirements);
+	GpuAllocation allocation = m_device.getAllocator().allocateForMove(memoryRequirements, *entry.allocation);
+	if (allocation == nullptr)
+	{
+		vkDestroyBuffer(m_device.getLogicalDevice(), buffer, nullptr);
+		return false;
+	}
+
+	if (vkBindBufferMemory(m_device.getLogicalDevice(), buffer, allocation->memory, allocation->offset) != VK_SUCCESS)
+	{
+		vkDestroyBuffer(m_device.getLogicalDevice(), buffer, nullptr);
+		freeGpuAllocation(allocation);
+		throw std::runtime_error("failed to bind buffer memory");
+	}
+
+	Move move;
+	move.entry = &entry;
+	move.buffer = buffer;
+	move.allocation = allocation;
+	move.ticket = m_copies.copy(*entry.buffer, buffer, entry.size);
+	m_moves.push_back(move);
+	entry.moving = true;
+	return true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "UploadManager.h"
+#include "DeletionQueue.h"
+#include <list>
+
+// Compacts GpuAllocator blocks a little every frame. Tracked buffers living in sparsely used shared blocks are
+// recreated in fuller blocks of the same type, copied on the GPU, and swapped into their owners' Cleaners once the
+// copy is done; the emptied blocks then go back to the driver through the allocator.
+// Only buffers whose contents don't change while a move is in flight should be tracked, typically static meshes and
+// particle buffers between simulation rebuilds; they need VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+class GpuDefragmenter
+{
+public:
+	// Called after the swap with the new buffer. Anything referencing the old one (descriptor sets, recorded command
+	// buffers) has to be updated before it returns. Without a deletion queue the old buffer is destroyed right after,
+	// so no pending GPU work may use it anymore; with one it lives until the frame being built is done
+	typedef std::function<void(VkBuffer)> MovedCallback;
+
+	explicit GpuDefragmenter(Device& device) : m_device(device), m_copies(device) {}
+	~GpuDefragmenter();
+
+	GpuDefragmenter(const GpuDefragmenter&) = delete;
+	GpuDefragmenter& operator=(const GpuDefragmenter&) = delete;
+
+	// Copies go to queue, which must be the family that uses the tracked buffers
+	void init(VkQueue queue, uint32_t queueFamilyIndex, DeletionQueue* deletionQueue = nullptr);
+	void destroy();
+
+	// The Cleaners must stay at the same address while tracked
+	void track(DeviceCleaner<VkBuffer, vkDestroyBuffer>& buffer, RootCleaner<GpuAllocation, freeGpuAllocation>& allocation, VkDeviceSize size, VkBufferUsageFlags usage, MovedCallback onMoved);
+	// Must be called before the tracked buffer is destroyed or replaced by its owner
+	void untrack(DeviceCleaner<VkBuffer, vkDestroyBuffer>& buffer);
+
+	// Finishes the moves whose copies are done and starts new ones worth up to maxBytes; call once per frame
+	void step(VkDeviceSize maxBytes);
+
+	// Blocks below this share in use are emptied
+	void setUsageThreshold(float usageThreshold) { m_usageThreshold = usageThreshold; }
+
+	uint64_t getMovesCount() const { return m_movesCount; }
+	VkDeviceSize getMovedBytes() const { return m_movedBytes; }
+
+private:
+	struct Entry
+	{
+		DeviceCleaner<VkBuffer, vkDestroyBuffer>* buffer;
+		RootCleaner<GpuAllocation, freeGpuAllocation>* allocation;
+		VkDeviceSize size;
+		VkBufferUsageFlags usage;
+		MovedCallback onMoved;
+		bool moving;
+	};
+
+	struct Move
+	{
+		Entry* entry;
+		VkBuffer buffer;
+		GpuAllocation allocation;
+		UploadTicket ticket;
+	};
+
+	void finishMoves();
+	// Waits for the copy and throws the new buffer away
+	void cancelMove(Move& move);
+	// Tracked entries in the emptiest shared block under the threshold, all from that one block
+	std::vector<Entry*> findSparseBlock();
+	bool startMove(Entry& entry);
+
+	Device& m_device;
+	UploadManager m_copies;
+	DeletionQueue* m_deletionQueue = nullptr;
+	float m_usageThreshold = 0.5f;
+
+	std::list<Entry> m_entries;
+	std::vector<Move> m_moves;
+	// Block whose buffers found no room elsewhere, skipped until the allocator's contents change
+	void* m_stuckBlock = nullptr;
+	uint32_t m_stuckAllocationsCount = 0;
+
+	uint64_t m_movesCount = 0;
+	VkDeviceSize m_movedBytes = 0;
+};
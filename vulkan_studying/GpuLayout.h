@@ -0,0 +1,174 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+// Compile-time GLSL block layout rules, to check that structs shared with shaders have the offsets
+// the shaders read them at. Only types with a GLSL equivalent are described, so a member such as
+// uint16_t or uint64_t fails to compile instead of silently shifting the fields after it.
+enum class GpuLayoutRule
+{
+	Std140,// uniform blocks
+	Std430// storage blocks
+};
+
+constexpr size_t gpuAlignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// Base alignment and size of one GLSL type
+template<typename T, GpuLayoutRule Rule>
+struct GpuTypeLayout;
+
+template<size_t Alignment, size_t Size>
+struct GpuTypeLayoutValues
+{
+	static constexpr size_t alignment = Alignment;
+	static constexpr size_t size = Size;
+};
+
+template<GpuLayoutRule Rule> struct GpuTypeLayout<float, Rule> : GpuTypeLayoutValues<4, 4> {};
+template<GpuLayoutRule Rule> struct GpuTypeLayout<int32_t, Rule> : GpuTypeLayoutValues<4, 4> {};
+template<GpuLayoutRule Rule> struct GpuTypeLayout<uint32_t, Rule> : GpuTypeLayoutValues<4, 4> {};
+
+// vec2 aligns to 2N, vec3 and vec4 to 4N; a vec3 is still only 3N long, so a scalar may follow inside its slot
+template<GpuLayoutRule Rule> struct GpuTypeLayout<glm::vec2, Rule> : GpuTypeLayoutValues<8, 8> {};
+template<GpuLayoutRule Rule> struct GpuTypeLayout<glm::vec3, Rule> : GpuTypeLayoutValues<16, 12> {};
+template<GpuLayoutRule Rule> struct GpuTypeLayout<glm::vec4, Rule> : GpuTypeLayoutValues<16, 16> {};
+template<GpuLayoutRule Rule> struct GpuTypeLayout<glm::ivec2, Rule> : GpuTypeLayoutValues<8, 8> {};
+template<GpuLayoutRule Rule> struct GpuTypeLayout<glm::ivec3, Rule> : GpuTypeLayoutValues<16, 12> {};
+template<GpuLayoutRule Rule> struct GpuTypeLayout<glm::ivec4, Rule> : GpuTypeLayoutValues<16, 16> {};
+template<GpuLayoutRule Rule> struct GpuTypeLayout<glm::uvec2, Rule> : GpuTypeLayoutValues<8, 8> {};
+template<GpuLayoutRule Rule> struct GpuTypeLayout<glm::uvec3, Rule> : GpuTypeLayoutValues<16, 12> {};
+template<GpuLayoutRule Rule> struct GpuTypeLayout<glm::uvec4, Rule> : GpuTypeLayoutValues<16, 16> {};
+
+// Arrays: std140 rounds the element stride and the alignment up to a vec4, std430 keeps the element's own
+template<typename T, size_t N, GpuLayoutRule Rule>
+struct GpuTypeLayout<T[N], Rule>
+{
+	static constexpr size_t alignment = Rule == GpuLayoutRule::Std140 ?
+		gpuAlignUp(GpuTypeLayout<T, Rule>::alignment, 16) : GpuTypeLayout<T, Rule>::alignment;
+	static constexpr size_t stride = gpuAlignUp(GpuTypeLayout<T, Rule>::size, alignment);
+	static constexpr size_t size = stride * N;
+};
+
+// Column-major matrices are arrays of column vectors; a mat3 column is a padded vec3, unlike glm::mat3
+template<GpuLayoutRule Rule> struct GpuTypeLayout<glm::mat3, Rule> : GpuTypeLayout<glm::vec3[3], Rule> {};
+template<GpuLayoutRule Rule> struct GpuTypeLayout<glm::mat4, Rule> : GpuTypeLayout<glm::vec4[4], Rule> {};
+
+// Offsets, size and padding of a block whose members are declared in the given order
+template<GpuLayoutRule Rule, typename... Members>
+struct GpuStructLayout
+{
+	static constexpr size_t count = sizeof...(Members);
+
+	static constexpr size_t offset(size_t index)
+	{
+		const size_t alignments[] = { GpuTypeLayout<Members, Rule>::alignment... };
+		const size_t sizes[] = { GpuTypeLayout<Members, Rule>::size... };
+
+		size_t offset = 0;
+		for (size_t i = 0; i <= index; i++)
+		{
+			offset = gpuAlignUp(offset, alignments[i]);
+			if (i != index)
+			{
+				offset += sizes[i];
+			}
+		}
+		return offset;
+	}
+
+	static constexpr size_t alignment()
+	{
+		const size_t alignments[] = { GpuTypeLayout<Members, Rule>::alignment... };
+
+		size_t alignment = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			alignment = alignment > alignments[i] ? alignment : alignments[i];
+		}
+		return Rule == GpuLayoutRule::Std140 ? gpuAlignUp(alignment, 16) : alignment;
+	}
+
+	// Size including the tail padding, which is also the array stride of the struct
+	static constexpr size_t size()
+	{
+		const size_t sizes[] = { GpuTypeLayout<Members, Rule>::size... };
+		return gpuAlignUp(offset(count - 1) + sizes[count - 1], alignment());
+	}
+
+	static constexpr size_t padding()
+	{
+		const size_t sizes[] = { GpuTypeLayout<Members, Rule>::size... };
+
+		size_t used = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			used += sizes[i];
+		}
+		return size() - used;
+	}
+
+	// Size of the members laid out in packedOrder()
+	static constexpr size_t packedSize()
+	{
+		const size_t alignments[] = { GpuTypeLayout<Members, Rule>::alignment... };
+		const size_t sizes[] = { GpuTypeLayout<Members, Rule>::size... };
+		Order order = packedOrder();
+
+		size_t offset = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			offset = gpuAlignUp(offset, alignments[order.index[i]]) + sizes[order.index[i]];
+		}
+		return gpuAlignUp(offset, alignment());
+	}
+
+	struct Order
+	{
+		size_t index[sizeof...(Members)];
+	};
+
+	// A declaration order with little padding: at every offset take the most aligned member that fits
+	// without padding, else the most aligned one left. This puts scalars in the tail of vec3s
+	static constexpr Order packedOrder()
+	{
+		const size_t alignments[] = { GpuTypeLayout<Members, Rule>::alignment... };
+		const size_t sizes[] = { GpuTypeLayout<Members, Rule>::size... };
+
+		Order order = {};
+		bool placed[sizeof...(Members)] = {};
+		size_t offset = 0;
+		for (size_t slot = 0; slot < count; slot++)
+		{
+			size_t best = count;
+			for (size_t i = 0; i < count; i++)
+			{
+				if (placed[i]) continue;
+
+				bool fits = offset % alignments[i] == 0;
+				bool bestFits = best != count && offset % alignments[best] == 0;
+				if (best == count || (fits && !bestFits) || (fits == bestFits && alignments[i] > alignments[best]))
+				{
+					best = i;
+				}
+			}
+
+			placed[best] = true;
+			order.index[slot] = best;
+			offset = gpuAlignUp(offset, alignments[best]) + sizes[best];
+		}
+		return order;
+	}
+};
+
+// Checks one member of a C++ struct against the layout of its GLSL declaration, members listed in GLSL order
+#define GPU_LAYOUT_CHECK_MEMBER(Struct, Layout, index, member) \
+	static_assert(offsetof(Struct, member) == Layout::offset(index), #Struct "::" #member " is not at its GLSL offset")
+
+// Checks the size, so arrays of the struct have the GLSL stride, and that packedOrder() would not pack it tighter
+#define GPU_LAYOUT_CHECK_SIZE(Struct, Layout) \
+	static_assert(sizeof(Struct) == Layout::size(), #Struct " does not have its GLSL size"); \
+	static_assert(Layout::size() <= Layout::packedSize(), #Struct " wastes padding, reorder its members")
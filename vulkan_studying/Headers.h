@@ -7,6 +7,8 @@
 #include <vector>
 #include <set>
 #include <cstring>
+#include <cmath>
+#include <limits>
 #include <string>
 #include <fstream>
 #include <chrono>
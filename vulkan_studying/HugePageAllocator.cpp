@@ -0,0 +1,116 @@
+#include "HugePageAllocator.h"
+#include <cstdint>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+namespace
+{
+	size_t alignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+#if defined(_WIN32)
+	// Large pages need SeLockMemoryPrivilege on the account, without it the process keeps ordinary pages
+	bool enableLockMemoryPrivilege()
+	{
+		HANDLE token;
+		if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+		{
+			return false;
+		}
+
+		TOKEN_PRIVILEGES privileges = {};
+		privileges.PrivilegeCount = 1;
+		privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		bool enabled = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+			AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+			GetLastError() == ERROR_SUCCESS;
+		CloseHandle(token);
+		return enabled;
+	}
+#endif
+}
+
+void* hugePageAllocate(size_t bytes)
+{
+	if (bytes < hugePageSize)
+	{
+		return ::operator new(bytes);
+	}
+
+#if defined(_WIN32)
+	// Windows backs large pages when they are allocated, on the allocating thread's node, so they skip first touch
+	static const size_t largePageSize = GetLargePageMinimum();
+	static const bool largePages = largePageSize != 0 && enableLockMemoryPrivilege();
+	if (largePages)
+	{
+		void* pointer = VirtualAlloc(nullptr, alignUp(bytes, largePageSize), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (pointer != nullptr)
+		{
+			return pointer;
+		}
+	}
+
+	void* pointer = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (pointer == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return pointer;
+#else
+	const size_t size = alignUp(bytes, hugePageSize);
+
+	// Reserved huge pages first, then transparent huge pages on a 2 MB aligned ordinary mapping
+	void* pointer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (pointer != MAP_FAILED)
+	{
+		return pointer;
+	}
+
+	pointer = mmap(nullptr, size + hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pointer == MAP_FAILED)
+	{
+		throw std::bad_alloc();
+	}
+
+	uintptr_t start = reinterpret_cast<uintptr_t>(pointer);
+	uintptr_t aligned = alignUp(start, hugePageSize);
+	if (aligned != start)
+	{
+		munmap(pointer, aligned - start);
+	}
+	size_t tail = start + size + hugePageSize - (aligned + size);
+	if (tail != 0)
+	{
+		munmap(reinterpret_cast<void*>(aligned + size), tail);
+	}
+
+	madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+	return reinterpret_cast<void*>(aligned);
+#endif
+}
+
+void hugePageFree(void* pointer, size_t bytes)
+{
+	if (pointer == nullptr)
+	{
+		return;
+	}
+	if (bytes < hugePageSize)
+	{
+		::operator delete(pointer);
+		return;
+	}
+
+#if defined(_WIN32)
+	VirtualFree(pointer, 0, MEM_RELEASE);
+#else
+	munmap(pointer, alignUp(bytes, hugePageSize));
+#endif
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+const size_t hugePageSize = size_t(2) << 20;
+
+// Blocks of at least hugePageSize come from 2 MB pages where the system offers them, which keeps TLB misses
+// down on arrays of gigabytes; smaller ones come from the ordinary heap. Pages only get a NUMA node when
+// first written, so big arrays should be first written by the threads that later use them
+void* hugePageAllocate(size_t bytes);
+void hugePageFree(void* pointer, size_t bytes);
+
+template<typename T>
+class HugePageAllocator
+{
+public:
+	typedef T value_type;
+
+	HugePageAllocator() {}
+	template<typename U>
+	HugePageAllocator(const HugePageAllocator<U>&) {}
+
+	T* allocate(size_t count) { return static_cast<T*>(hugePageAllocate(count * sizeof(T))); }
+	void deallocate(T* pointer, size_t count) { hugePageFree(pointer, count * sizeof(T)); }
+
+	// resize() leaves new elements of trivial types unwritten, so the first real write places the page instead
+	// of the resizing thread; use assign() where the elements need a value
+	template<typename U>
+	void construct(U* pointer)
+	{
+		constructDefault(pointer, std::integral_constant<bool, std::is_trivially_destructible<U>::value && std::is_trivially_copyable<U>::value>());
+	}
+
+	template<typename U, typename... Arguments>
+	void construct(U* pointer, Arguments&&... arguments)
+	{
+		::new(static_cast<void*>(pointer)) U(std::forward<Arguments>(arguments)...);
+	}
+
+private:
+	template<typename U>
+	static void constructDefault(U*, std::true_type) {}
+
+	template<typename U>
+	static void constructDefault(U* pointer, std::false_type) { ::new(static_cast<void*>(pointer)) U(); }
+};
+
+template<typename T, typename U>
+bool operator==(const HugePageAllocator<T>&, const HugePageAllocator<U>&) { return true; }
+
+template<typename T, typename U>
+bool operator!=(const HugePageAllocator<T>&, const HugePageAllocator<U>&) { return false; }
+
+template<typename T>
+using HugePageVector = std::vector<T, HugePageAllocator<T>>;
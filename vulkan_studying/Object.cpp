@@ -1,11 +1,30 @@
 #include "Object.h"
 
 
-Object::Object()
+Object::Object() :
+	m_transform(1.0f)
 {
 }
 
+Object::Object(std::vector<Vertex> vertices, std::vector<uint32_t> indices) :
+	m_vertices(std::move(vertices)),
+	m_indices(std::move(indices)),
+	m_transform(1.0f)
+{
+	if (m_indices.size() % 3 != 0)
+	{
+		throw std::runtime_error("object indices must form whole triangles");
+	}
+}
 
 Object::~Object()
 {
 }
+
+void Object::draw()
+{
+}
+
+void Object::update()
+{
+}
@@ -1,10 +1,29 @@
 #pragma once
 #include "Entity.h"
+#include <vulkan/vulkan.h>
+#include "Vertex.h"
+
+// Static or deforming triangle mesh; vertices are in object space and placed by the transform
 class Object :
 	public Entity
 {
 public:
 	Object();
+	Object(std::vector<Vertex> vertices, std::vector<uint32_t> indices);
 	~Object();
-};
 
+	void draw() override;
+	void update() override;
+
+	std::vector<Vertex>& getVertices() { return m_vertices; }
+	const std::vector<uint32_t>& getIndices() const { return m_indices; }
+	size_t getTrianglesCount() const { return m_indices.size() / 3; }
+
+	const glm::mat4& getTransform() const { return m_transform; }
+	void setTransform(const glm::mat4& transform) { m_transform = transform; }
+
+private:
+	std::vector<Vertex> m_vertices;
+	std::vector<uint32_t> m_indices;// three per triangle
+	glm::mat4 m_transform;
+};
@@ -0,0 +1,196 @@
+#include "Parallel.h"
+
+#include <memory>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+ThreadPin::ThreadPin(uint32_t core)
+{
+	core %= hardwareThreads();
+
+#if defined(_WIN32)
+	if (core >= sizeof(DWORD_PTR) * 8)
+	{
+		return;
+	}
+	DWORD_PTR previous = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+	if (previous != 0)
+	{
+		m_previous.resize(sizeof(previous));
+		memcpy(m_previous.data(), &previous, sizeof(previous));
+		m_pinned = true;
+	}
+#elif defined(__linux__)
+	cpu_set_t previous;
+	if (pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) != 0)
+	{
+		return;
+	}
+
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	CPU_SET(core, &mask);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0)
+	{
+		m_previous.resize(sizeof(previous));
+		memcpy(m_previous.data(), &previous, sizeof(previous));
+		m_pinned = true;
+	}
+#endif
+}
+
+ThreadPin::~ThreadPin()
+{
+	if (!m_pinned)
+	{
+		return;
+	}
+
+#if defined(_WIN32)
+	DWORD_PTR previous;
+	memcpy(&previous, m_previous.data(), sizeof(previous));
+	SetThreadAffinityMask(GetCurrentThread(), previous);
+#elif defined(__linux__)
+	cpu_set_t previous;
+	memcpy(&previous, m_previous.data(), sizeof(previous));
+	pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+#endif
+}
+
+uint32_t reserveCores(uint32_t count)
+{
+	static std::atomic<uint32_t> nextCore(0);
+	return nextCore.fetch_add(count) % hardwareThreads();
+}
+
+WorkerPool::WorkerPool(uint32_t threadsCount, uint32_t firstCore) :
+	m_threadsCount(threadsCount == 0 ? hardwareThreads() : threadsCount),
+	m_firstCore(firstCore)
+{
+	try
+	{
+		m_threads.reserve(m_threadsCount - 1);
+		for (uint32_t thread = 1; thread < m_threadsCount; thread++)
+		{
+			m_threads.emplace_back(&WorkerPool::work, this, thread);
+		}
+	}
+	catch (...)
+	{
+		// The destructor won't run, the workers that did start have to be stopped here
+		stop();
+		throw;
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+void WorkerPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+void WorkerPool::dispatch(Job job, void* context)
+{
+	if (m_threads.empty())
+	{
+		job(context, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_job = job;
+		m_context = context;
+		m_busyCount = static_cast<uint32_t>(m_threads.size());
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	try
+	{
+		job(context, 0);
+	}
+	catch (...)
+	{
+		fail(std::current_exception());
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this]() { return m_busyCount == 0; });
+	std::exception_ptr error = m_error;
+	m_error = nullptr;
+	lock.unlock();
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+void WorkerPool::work(uint32_t thread)
+{
+	std::unique_ptr<ThreadPin> pin;
+	if (m_firstCore != unpinned)
+	{
+		pin.reset(new ThreadPin(m_firstCore + thread - 1));
+	}
+	uint64_t generation = 0;
+	for (;;)
+	{
+		Job job;
+		void* context;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&]() { return m_stopping || m_generation != generation; });
+			if (m_stopping)
+			{
+				return;
+			}
+			generation = m_generation;
+			job = m_job;
+			context = m_context;
+		}
+
+		try
+		{
+			job(context, thread);
+		}
+		catch (...)
+		{
+			fail(std::current_exception());
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_busyCount == 0)
+		{
+			m_done.notify_one();
+		}
+	}
+}
+
+void WorkerPool::fail(std::exception_ptr error)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_error)
+	{
+		m_error = error;
+	}
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include "Headers.h"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+inline uint32_t hardwareThreads()
+{
+	return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+// Keeps the current thread on one core while it lives, so the pages it touches first stay on that core's NUMA node;
+// the previous affinity comes back on destruction. Where pinning is unsupported it does nothing
+class ThreadPin
+{
+public:
+	explicit ThreadPin(uint32_t core);
+	~ThreadPin();
+
+	ThreadPin(const ThreadPin&) = delete;
+	ThreadPin& operator=(const ThreadPin&) = delete;
+
+private:
+	bool m_pinned = false;
+	std::vector<uint8_t> m_previous;// platform affinity mask to restore
+};
+
+// Runs function(index) for every index in [0, count) on up to threadsCount threads, 0 meaning all cores.
+// Indices are handed out one at a time, so uneven work balances itself; the calling thread works too.
+// The first exception thrown by any call is rethrown here once every thread has stopped
+template<typename Function>
+void parallelFor(size_t count, Function function, uint32_t threadsCount = 0)
+{
+	if (threadsCount == 0)
+	{
+		threadsCount = hardwareThreads();
+	}
+	threadsCount = static_cast<uint32_t>(std::min<size_t>(threadsCount, count));
+	if (threadsCount <= 1)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			function(i);
+		}
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	auto worker = [&]()
+	{
+		try
+		{
+			for (size_t i = next++; i < count; i = next++)
+			{
+				function(i);
+			}
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (!error)
+			{
+				error = std::current_exception();
+			}
+			next = count;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(threadsCount - 1);
+	for (uint32_t i = 1; i < threadsCount; i++)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+// First of count consecutive cores (modulo the core count) that no earlier call handed out, so pinned pools
+// created one after another only share cores once there are more workers than cores
+uint32_t reserveCores(uint32_t count);
+
+// Persistent workers for passes that run many times a frame, so no pass pays for starting threads. The calling
+// thread joins in as worker 0 and is left wherever it runs; pinned pools keep worker t on core firstCore + t - 1
+// for as long as they live, so arrays first written through forRanges keep those ranges on the node of the
+// thread that works on them, pass after pass. Only one thread at a time may run work on a pool
+class WorkerPool
+{
+public:
+	static const uint32_t unpinned = ~0u;
+
+	// 0 threads meaning all cores
+	explicit WorkerPool(uint32_t threadsCount = 0, uint32_t firstCore = unpinned);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// Runs function(thread) once on every worker and returns when all of them are done.
+	// The first exception thrown by any call is rethrown here
+	template<typename Function>
+	void run(Function function)
+	{
+		dispatch([](void* context, uint32_t thread) { (*static_cast<Function*>(context))(thread); }, &function);
+	}
+
+	// Runs function(begin, end) on every worker over its own contiguous part of [0, count)
+	template<typename Function>
+	void forRanges(size_t count, Function function)
+	{
+		run([&](uint32_t thread)
+		{
+			function(getRangeBegin(count, thread), getRangeBegin(count, thread + 1));
+		});
+	}
+
+	// Where the part of [0, count) owned by thread starts; the same for every pass over the same count
+	size_t getRangeBegin(size_t count, uint32_t thread) const { return count * thread / m_threadsCount; }
+	uint32_t getThreadsCount() const { return m_threadsCount; }
+
+private:
+	typedef void (*Job)(void* context, uint32_t thread);
+
+	void dispatch(Job job, void* context);
+	void stop();
+	void work(uint32_t thread);
+	void fail(std::exception_ptr error);
+
+	uint32_t m_threadsCount;
+	uint32_t m_firstCore;
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	Job m_job = nullptr;
+	void* m_context = nullptr;
+	uint64_t m_generation = 0;// bumped for every job, workers wait for it to change
+	uint32_t m_busyCount = 0;// workers still on the current job
+	bool m_stopping = false;
+	std::exception_ptr m_error;
+};
@@ -12,7 +12,7 @@ Swapchain::~Swapchain()
 {
 }
 
-void Swapchain::createSurface(Window* window, Cleaner<VkInstance>& instance)
+void Swapchain::createSurface(Window* window, VkInstance instance)
 {
 	SDL_SysWMinfo info = {};
 	SDL_GetWindowWMInfo(window->getWindow(), &info);
@@ -25,9 +25,8 @@ void Swapchain::createSurface(Window* window, Cleaner<VkInstance>& instance)
 
 	auto CreateWin32SurfaceKHR = (PFN_vkCreateWin32SurfaceKHR)vkGetInstanceProcAddr(instance, "vkCreateWin32SurfaceKHR");
 
-	m_surface = Cleaner<VkSurfaceKHR>{ instance, vkDestroySurfaceKHR };
 	if (!CreateWin32SurfaceKHR || CreateWin32SurfaceKHR(instance, &win32SurfaceCreateInfoKhr,
-		nullptr, m_surface.data()) != VK_SUCCESS) {
+		nullptr, m_surface.data(instance)) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create window surface");
 	}
 #elif defined(__ANDROID__)
@@ -49,11 +48,6 @@ void Swapchain::createSwapchain(Device& device, uint32_t width, uint32_t height)
 {
 	setSwapchainSupportDetails(device.getPhysicalDevice());
 
-	if(m_swapchain == nullptr)
-	{
-		m_swapchain = Cleaner<VkSwapchainKHR>{ device.getLogicalDevice(), vkDestroySwapchainKHR };
-	}
-
 	VkSurfaceFormatKHR surfaceFormat = getSwapSurfaceFormat(swapchainSupportDetails.formats);
 	VkPresentModeKHR presentMode = getSwapPresentMode(swapchainSupportDetails.presentModes);
 	VkExtent2D extent = getSwapExtent(swapchainSupportDetails.capabilities, width, height);
@@ -99,7 +93,7 @@ void Swapchain::createSwapchain(Device& device, uint32_t width, uint32_t height)
 	if (vkCreateSwapchainKHR(device.getLogicalDevice(), &swapChainCreateInfo, nullptr, &newSwapchain) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create swap chain");
 	}
-	m_swapchain = newSwapchain;
+	m_swapchain.reset(device.getLogicalDevice(), newSwapchain);
 
 
 	if (vkGetSwapchainImagesKHR(device.getLogicalDevice(), m_swapchain, &imageCount, nullptr) != VK_SUCCESS)
@@ -119,7 +113,7 @@ void Swapchain::createSwapchain(Device& device, uint32_t width, uint32_t height)
 void Swapchain::createImageViews(Device& device)
 {
 	//auto swapchainImages = m_swapchain.getSwapchainImages();
-	m_swapchainImageViews.resize(m_swapchainImages.size(), Cleaner<VkImageView>{device.getLogicalDevice(), vkDestroyImageView});
+	m_swapchainImageViews.resize(m_swapchainImages.size());
 	//auto imageFormat = m_swapchain.getSwapchainImageFormat();
 
 	for (uint32_t i = 0; i < m_swapchainImages.size(); i++)
@@ -139,7 +133,7 @@ void Swapchain::createImageViews(Device& device)
 		createInfo.subresourceRange.baseArrayLayer = 0;
 		createInfo.subresourceRange.layerCount = 1;
 
-		if (vkCreateImageView(device.getLogicalDevice(), &createInfo, nullptr, m_swapchainImageViews[i].data()) != VK_SUCCESS) {
+		if (vkCreateImageView(device.getLogicalDevice(), &createInfo, nullptr, m_swapchainImageViews[i].data(device.getLogicalDevice())) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create image views");
 		}
 	}
@@ -0,0 +1,292 @@
+#include "TlsfAllocator.h"
+
+
+namespace
+{
+	uint32_t findLowestBit(uint64_t value)
+	{
+		uint32_t bit = 0;
+		while ((value & 1) == 0)
+		{
+			value >>= 1;
+			bit++;
+		}
+		return bit;
+	}
+
+	uint32_t findHighestBit(uint64_t value)
+	{
+		uint32_t bit = 0;
+		while (value >>= 1)
+		{
+			bit++;
+		}
+		return bit;
+	}
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t size) :
+	m_size(size),
+	m_freeSize(size)
+{
+	for (auto& lists : m_freeLists)
+	{
+		std::fill(std::begin(lists), std::end(lists), invalidChunk);
+	}
+
+	if (size != 0)
+	{
+		uint32_t chunk = createChunk(0, size);
+		insertFree(chunk);
+	}
+}
+
+bool TlsfAllocator::allocate(uint64_t size, uint64_t alignment, Allocation& allocation)
+{
+	size = std::max<uint64_t>(size, 1);
+	alignment = std::max<uint64_t>(alignment, 1);
+
+	// Offsets are usually aligned already, so try the plain size first and only pay for the padding when that fails
+	uint32_t chunk = findFreeChunk(size);
+	if (chunk == invalidChunk || ((m_chunks[chunk].offset + alignment - 1) & ~(alignment - 1)) + size > m_chunks[chunk].offset + m_chunks[chunk].size)
+	{
+		chunk = findFreeChunk(size + alignment - 1);
+		if (chunk == invalidChunk)
+		{
+			return false;
+		}
+	}
+
+	removeFree(chunk);
+	const uint64_t padding = ((m_chunks[chunk].offset + alignment - 1) & ~(alignment - 1)) - m_chunks[chunk].offset;
+	if (padding != 0)
+	{
+		splitFront(chunk, padding);
+	}
+	if (m_chunks[chunk].size > size)
+	{
+		splitBack(chunk, size);
+	}
+
+	m_chunks[chunk].free = false;
+	m_freeSize -= m_chunks[chunk].size;
+	m_allocationsCount++;
+
+	allocation.offset = m_chunks[chunk].offset;
+	allocation.chunk = chunk;
+	return true;
+}
+
+void TlsfAllocator::free(uint32_t chunk)
+{
+	if (chunk >= m_chunks.size() || m_chunks[chunk].free)
+	{
+		throw std::runtime_error("tlsf chunk is not allocated");
+	}
+
+	m_chunks[chunk].free = true;
+	m_freeSize += m_chunks[chunk].size;
+	m_allocationsCount--;
+
+	uint32_t previous = m_chunks[chunk].previousPhysical;
+	if (previous != invalidChunk && m_chunks[previous].free)
+	{
+		removeFree(previous);
+		merge(previous, chunk);
+		chunk = previous;
+	}
+	uint32_t next = m_chunks[chunk].nextPhysical;
+	if (next != invalidChunk && m_chunks[next].free)
+	{
+		removeFree(next);
+		merge(chunk, next);
+	}
+	insertFree(chunk);
+}
+
+uint64_t TlsfAllocator::getLargestFreeSize() const
+{
+	if (m_firstLevelBitmap == 0)
+	{
+		return 0;
+	}
+
+	uint32_t firstLevel = findHighestBit(m_firstLevelBitmap);
+	uint64_t largest = 0;
+	for (uint32_t chunk = m_freeLists[firstLevel][findHighestBit(m_secondLevelBitmaps[firstLevel])]; chunk != invalidChunk; chunk = m_chunks[chunk].nextFree)
+	{
+		largest = std::max(largest, m_chunks[chunk].size);
+	}
+	return largest;
+}
+
+void TlsfAllocator::getLevels(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel)
+{
+	// Sizes below 16 share the first class one byte apart, every power of two above gets 16 equal classes
+	if (size < secondLevelCount)
+	{
+		firstLevel = 0;
+		secondLevel = static_cast<uint32_t>(size);
+		return;
+	}
+	uint32_t highest = findHighestBit(size);
+	firstLevel = highest - secondLevelLog2 + 1;
+	secondLevel = static_cast<uint32_t>(size >> (highest - secondLevelLog2)) ^ secondLevelCount;
+}
+
+uint32_t TlsfAllocator::findFreeChunk(uint64_t size) const
+{
+	// Round up to the next class boundary so any chunk of the class found is big enough
+	if (size >= secondLevelCount)
+	{
+		uint64_t rounded = size + (uint64_t(1) << (findHighestBit(size) - secondLevelLog2)) - 1;
+		if (rounded < size)
+		{
+			return invalidChunk;
+		}
+		size = rounded;
+	}
+
+	uint32_t firstLevel, secondLevel;
+	getLevels(size, firstLevel, secondLevel);
+	if (firstLevel >= firstLevelCount)
+	{
+		return invalidChunk;
+	}
+
+	uint32_t secondLevelMap = m_secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+	if (secondLevelMap == 0)
+	{
+		uint64_t firstLevelMap = firstLevel + 1 < 64 ? m_firstLevelBitmap & (~uint64_t(0) << (firstLevel + 1)) : 0;
+		if (firstLevelMap == 0)
+		{
+			return invalidChunk;
+		}
+		firstLevel = findLowestBit(firstLevelMap);
+		secondLevelMap = m_secondLevelBitmaps[firstLevel];
+	}
+	return m_freeLists[firstLevel][findLowestBit(secondLevelMap)];
+}
+
+uint32_t TlsfAllocator::createChunk(uint64_t offset, uint64_t size)
+{
+	uint32_t chunk;
+	if (!m_unusedChunks.empty())
+	{
+		chunk = m_unusedChunks.back();
+		m_unusedChunks.pop_back();
+	}
+	else
+	{
+		chunk = static_cast<uint32_t>(m_chunks.size());
+		m_chunks.emplace_back();
+	}
+
+	Chunk& data = m_chunks[chunk];
+	data.offset = offset;
+	data.size = size;
+	data.previousPhysical = invalidChunk;
+	data.nextPhysical = invalidChunk;
+	data.previousFree = invalidChunk;
+	data.nextFree = invalidChunk;
+	data.free = false;
+	return chunk;
+}
+
+void TlsfAllocator::destroyChunk(uint32_t chunk)
+{
+	m_unusedChunks.push_back(chunk);
+}
+
+void TlsfAllocator::insertFree(uint32_t chunk)
+{
+	Chunk& data = m_chunks[chunk];
+	data.free = true;
+
+	uint32_t firstLevel, secondLevel;
+	getLevels(data.size, firstLevel, secondLevel);
+
+	uint32_t& head = m_freeLists[firstLevel][secondLevel];
+	data.previousFree = invalidChunk;
+	data.nextFree = head;
+	if (head != invalidChunk)
+	{
+		m_chunks[head].previousFree = chunk;
+	}
+	head = chunk;
+
+	m_firstLevelBitmap |= uint64_t(1) << firstLevel;
+	m_secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+}
+
+void TlsfAllocator::removeFree(uint32_t chunk)
+{
+	Chunk& data = m_chunks[chunk];
+
+	uint32_t firstLevel, secondLevel;
+	getLevels(data.size, firstLevel, secondLevel);
+
+	if (data.previousFree != invalidChunk)
+	{
+		m_chunks[data.previousFree].nextFree = data.nextFree;
+	}
+	else
+	{
+		m_freeLists[firstLevel][secondLevel] = data.nextFree;
+	}
+	if (data.nextFree != invalidChunk)
+	{
+		m_chunks[data.nextFree].previousFree = data.previousFree;
+	}
+
+	if (m_freeLists[firstLevel][secondLevel] == invalidChunk)
+	{
+		m_secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+		if (m_secondLevelBitmaps[firstLevel] == 0)
+		{
+			m_firstLevelBitmap &= ~(uint64_t(1) << firstLevel);
+		}
+	}
+	data.previousFree = invalidChunk;
+	data.nextFree = invalidChunk;
+}
+
+void TlsfAllocator::splitFront(uint32_t chunk, uint64_t size)
+{
+	uint32_t front = createChunk(m_chunks[chunk].offset, size);
+	m_chunks[front].previousPhysical = m_chunks[chunk].previousPhysical;
+	m_chunks[front].nextPhysical = chunk;
+	if (m_chunks[chunk].previousPhysical != invalidChunk)
+	{
+		m_chunks[m_chunks[chunk].previousPhysical].nextPhysical = front;
+	}
+	m_chunks[chunk].previousPhysical = front;
+	m_chunks[chunk].offset += size;
+	m_chunks[chunk].size -= size;
+	insertFree(front);
+}
+
+void TlsfAllocator::splitBack(uint32_t chunk, uint64_t size)
+{
+	uint32_t back = createChunk(m_chunks[chunk].offset + size, m_chunks[chunk].size - size);
+	m_chunks[back].previousPhysical = chunk;
+	m_chunks[back].nextPhysical = m_chunks[chunk].nextPhysical;
+	if (m_chunks[chunk].nextPhysical != invalidChunk)
+	{
+		m_chunks[m_chunks[chunk].nextPhysical].previousPhysical = back;
+	}
+	m_chunks[chunk].nextPhysical = back;
+	m_chunks[chunk].size = size;
+	insertFree(back);
+}
+
+void TlsfAllocator::merge(uint32_t chunk, uint32_t next)
+{
+	m_chunks[chunk].size += m_chunks[next].size;
+	m_chunks[chunk].nextPhysical = m_chunks[next].nextPhysical;
+	if (m_chunks[next].nextPhysical != invalidChunk)
+	{
+		m_chunks[m_chunks[next].nextPhysical].previousPhysical = chunk;
+	}
+	destroyChunk(next);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "Headers.h"
+
+// Two level segregated fit allocator (Masmano et al. 2004) over an abstract range of offsets; it never touches memory.
+// Free chunks sit in lists by size class, a first level bitmap per power of two and a second level one splitting each
+// power into 16 classes find a fitting list in constant time, and freed chunks merge with free neighbours right away
+class TlsfAllocator
+{
+public:
+	static const uint32_t invalidChunk = ~0u;
+
+	struct Allocation
+	{
+		uint64_t offset;
+		uint32_t chunk;// handle for free()
+	};
+
+	explicit TlsfAllocator(uint64_t size);
+
+	// Returns false when no free chunk can hold size bytes at the alignment, a power of two
+	bool allocate(uint64_t size, uint64_t alignment, Allocation& allocation);
+	void free(uint32_t chunk);
+
+	uint64_t getSize() const { return m_size; }
+	uint64_t getFreeSize() const { return m_freeSize; }
+	// Biggest single free chunk; only the top non-empty size class is scanned
+	uint64_t getLargestFreeSize() const;
+	uint32_t getAllocationsCount() const { return m_allocationsCount; }
+	bool isEmpty() const { return m_allocationsCount == 0; }
+
+private:
+	static const uint32_t secondLevelLog2 = 4;
+	static const uint32_t secondLevelCount = 1u << secondLevelLog2;
+	static const uint32_t firstLevelCount = 65 - secondLevelLog2;
+
+	struct Chunk
+	{
+		uint64_t offset;
+		uint64_t size;
+		uint32_t previousPhysical;
+		uint32_t nextPhysical;
+		uint32_t previousFree;
+		uint32_t nextFree;
+		bool free;
+	};
+
+	static void getLevels(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel);
+	uint32_t findFreeChunk(uint64_t size) const;
+
+	uint32_t createChunk(uint64_t offset, uint64_t size);
+	void destroyChunk(uint32_t chunk);
+	void insertFree(uint32_t chunk);
+	void removeFree(uint32_t chunk);
+	// Cuts [offset, offset + size) off the front of a used chunk into a new free chunk placed before it
+	void splitFront(uint32_t chunk, uint64_t size);
+	void splitBack(uint32_t chunk, uint64_t size);
+	// Merges next into chunk, next is dropped
+	void merge(uint32_t chunk, uint32_t next);
+
+	uint64_t m_size;
+	uint64_t m_freeSize;
+	uint32_t m_allocationsCount = 0;
+
+	std::vector<Chunk> m_chunks;
+	std::vector<uint32_t> m_unusedChunks;
+
+	uint64_t m_firstLevelBitmap = 0;
+	uint32_t m_secondLevelBitmaps[firstLevelCount] = {};
+	uint32_t m_freeLists[firstLevelCount][secondLevelCount];
+};
@@ -0,0 +1,276 @@
+#include "TriangleBvh.h"
+#include <numeric>
+
+
+float TriangleBvh::Bounds::area() const
+{
+	glm::vec3 extent = maximum - minimum;
+	if (extent.x < 0.0f || extent.y < 0.0f || extent.z < 0.0f)
+	{
+		return 0.0f;
+	}
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+void TriangleBvh::build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+{
+	if (indices.size() % 3 != 0)
+	{
+		throw std::runtime_error("bvh indices must form whole triangles");
+	}
+
+	m_positions = positions;
+	m_indices = indices;
+
+	const uint32_t count = static_cast<uint32_t>(m_indices.size() / 3);
+	m_centroids.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		m_centroids[i] = (m_positions[m_indices[3 * i]] + m_positions[m_indices[3 * i + 1]] + m_positions[m_indices[3 * i + 2]]) / 3.0f;
+	}
+	m_order.resize(count);
+	std::iota(m_order.begin(), m_order.end(), 0u);
+
+	m_nodes.clear();
+	m_buildCost = 0.0f;
+	if (count == 0)
+	{
+		return;
+	}
+
+	// A binary tree with leaves of at least one triangle never has more than 2n - 1 nodes
+	m_nodes.reserve(2 * static_cast<size_t>(count));
+	Node root = {};
+	root.first = 0;
+	root.count = count;
+	updateBounds(root);
+	m_nodes.push_back(root);
+
+	subdivide(0, 0);
+	m_buildCost = getCost();
+}
+
+void TriangleBvh::refit(const std::vector<glm::vec3>& positions)
+{
+	if (positions.size() != m_positions.size())
+	{
+		throw std::runtime_error("bvh refit needs the vertices it was built from");
+	}
+	m_positions = positions;
+
+	// Children always come after their parent, so walking backwards sees them first
+	for (size_t i = m_nodes.size(); i-- > 0;)
+	{
+		Node& node = m_nodes[i];
+		if (node.count > 0)
+		{
+			updateBounds(node);
+		}
+		else
+		{
+			const Node& left = m_nodes[node.first];
+			const Node& right = m_nodes[node.first + 1];
+			node.minimum = glm::min(left.minimum, right.minimum);
+			node.maximum = glm::max(left.maximum, right.maximum);
+		}
+	}
+}
+
+float TriangleBvh::getCost() const
+{
+	if (m_nodes.empty())
+	{
+		return 0.0f;
+	}
+
+	Bounds root;
+	root.minimum = m_nodes[0].minimum;
+	root.maximum = m_nodes[0].maximum;
+	float rootArea = root.area();
+	if (rootArea <= 0.0f)
+	{
+		return static_cast<float>(getTrianglesCount());
+	}
+
+	// A node is visited with probability area / root area; one unit per box test, one per triangle test
+	float cost = 0.0f;
+	for (const Node& node : m_nodes)
+	{
+		Bounds bounds;
+		bounds.minimum = node.minimum;
+		bounds.maximum = node.maximum;
+		cost += bounds.area() / rootArea * (node.count > 0 ? static_cast<float>(node.count) : 1.0f);
+	}
+	return cost;
+}
+
+void TriangleBvh::subdivide(uint32_t nodeIndex, uint32_t depth)
+{
+	const Node node = m_nodes[nodeIndex];
+	if (node.count <= leafSize || depth >= maxDepth)
+	{
+		return;
+	}
+
+	Bounds centroidBounds;
+	for (uint32_t i = node.first; i < node.first + node.count; i++)
+	{
+		centroidBounds.grow(m_centroids[m_order[i]]);
+	}
+
+	// Bin the centroids along every axis and sweep the bin boundaries for the cheapest split
+	float bestCost = std::numeric_limits<float>::max();
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = centroidBounds.maximum[axis] - centroidBounds.minimum[axis];
+		if (extent <= 0.0f)
+		{
+			continue;
+		}
+
+		Bin bins[binsCount];
+		float scale = binsCount / extent;
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			uint32_t triangle = m_order[i];
+			uint32_t bin = std::min(binsCount - 1, static_cast<uint32_t>((m_centroids[triangle][axis] - centroidBounds.minimum[axis]) * scale));
+			bins[bin].count++;
+			bins[bin].bounds.grow(getTriangleBounds(triangle));
+		}
+
+		float leftCosts[binsCount - 1];
+		Bounds left;
+		uint32_t leftCount = 0;
+		for (uint32_t split = 0; split < binsCount - 1; split++)
+		{
+			left.grow(bins[split].bounds);
+			leftCount += bins[split].count;
+			leftCosts[split] = leftCount * left.area();
+		}
+
+		Bounds right;
+		uint32_t rightCount = 0;
+		for (uint32_t split = binsCount - 1; split > 0; split--)
+		{
+			right.grow(bins[split].bounds);
+			rightCount += bins[split].count;
+			float cost = leftCosts[split - 1] + rightCount * right.area();
+			if (cost < bestCost && rightCount > 0 && rightCount < node.count)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	// Splitting costs one box test per child visit, stay a leaf unless that pays off
+	Bounds nodeBounds;
+	nodeBounds.minimum = node.minimum;
+	nodeBounds.maximum = node.maximum;
+	float nodeArea = nodeBounds.area();
+	if (bestAxis < 0 || nodeArea + bestCost >= node.count * nodeArea)
+	{
+		return;
+	}
+
+	float scale = binsCount / (centroidBounds.maximum[bestAxis] - centroidBounds.minimum[bestAxis]);
+	auto middle = std::partition(m_order.begin() + node.first, m_order.begin() + node.first + node.count,
+		[&](uint32_t triangle)
+	{
+		uint32_t bin = std::min(binsCount - 1, static_cast<uint32_t>((m_centroids[triangle][bestAxis] - centroidBounds.minimum[bestAxis]) * scale));
+		return bin < bestSplit;
+	});
+	uint32_t leftCount = static_cast<uint32_t>(middle - m_order.begin()) - node.first;
+
+	uint32_t leftIndex = static_cast<uint32_t>(m_nodes.size());
+	Node leftNode = {};
+	leftNode.first = node.first;
+	leftNode.count = leftCount;
+	updateBounds(leftNode);
+	Node rightNode = {};
+	rightNode.first = node.first + leftCount;
+	rightNode.count = node.count - leftCount;
+	updateBounds(rightNode);
+	m_nodes.push_back(leftNode);
+	m_nodes.push_back(rightNode);
+
+	m_nodes[nodeIndex].first = leftIndex;
+	m_nodes[nodeIndex].count = 0;
+
+	subdivide(leftIndex, depth + 1);
+	subdivide(leftIndex + 1, depth + 1);
+}
+
+void TriangleBvh::updateBounds(Node& node) const
+{
+	Bounds bounds;
+	for (uint32_t i = node.first; i < node.first + node.count; i++)
+	{
+		bounds.grow(getTriangleBounds(m_order[i]));
+	}
+	node.minimum = bounds.minimum;
+	node.maximum = bounds.maximum;
+}
+
+TriangleBvh::Bounds TriangleBvh::getTriangleBounds(uint32_t triangle) const
+{
+	Bounds bounds;
+	bounds.grow(m_positions[m_indices[3 * triangle]]);
+	bounds.grow(m_positions[m_indices[3 * triangle + 1]]);
+	bounds.grow(m_positions[m_indices[3 * triangle + 2]]);
+	return bounds;
+}
+
+glm::vec3 TriangleBvh::closestPointOnTriangle(const glm::vec3& point, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	// Voronoi regions of the vertices, then the edges, then the face (Ericson, Real-Time Collision Detection 5.1.5)
+	glm::vec3 ab = b - a;
+	glm::vec3 ac = c - a;
+	glm::vec3 ap = point - a;
+	float d1 = glm::dot(ab, ap);
+	float d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+	{
+		return a;
+	}
+
+	glm::vec3 bp = point - b;
+	float d3 = glm::dot(ab, bp);
+	float d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+	{
+		return b;
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+	{
+		return a + ab * (d1 / (d1 - d3));
+	}
+
+	glm::vec3 cp = point - c;
+	float d5 = glm::dot(ab, cp);
+	float d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+	{
+		return c;
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+	{
+		return a + ac * (d2 / (d2 - d6));
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+	{
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	}
+
+	float denominator = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "Headers.h"
+
+// Bounding volume hierarchy over a triangle soup, built with the binned surface area heuristic.
+// Triangles refer to vertices by index, so a mesh that only deforms keeps its tree and just refits the bounds
+class TriangleBvh
+{
+public:
+	struct Node
+	{
+		glm::vec3 minimum;
+		uint32_t first;// leaf: first entry of m_order, interior: left child, the right one follows it
+		glm::vec3 maximum;
+		uint32_t count;// triangles in a leaf, 0 for interior nodes
+	};
+
+	// Deepest path a query can take, the traversal stack lives in the querying thread's own frame
+	static const uint32_t maxDepth = 64;
+
+	void build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices);
+	// Same triangles, moved vertices: bounds are recomputed bottom-up and the topology kept
+	void refit(const std::vector<glm::vec3>& positions);
+
+	// Calls function(triangle) for every triangle whose leaf bounds overlap the sphere; safe from many threads at once
+	template<typename Function>
+	void forEachTriangle(const glm::vec3& center, float radius, Function& function) const
+	{
+		if (m_nodes.empty())
+		{
+			return;
+		}
+
+		uint32_t stack[maxDepth + 1];
+		uint32_t size = 0;
+		stack[size++] = 0;
+		while (size > 0)
+		{
+			const Node& node = m_nodes[stack[--size]];
+			glm::vec3 nearest = glm::clamp(center, node.minimum, node.maximum) - center;
+			if (glm::dot(nearest, nearest) > radius * radius)
+			{
+				continue;
+			}
+
+			if (node.count > 0)
+			{
+				for (uint32_t i = node.first; i < node.first + node.count; i++)
+				{
+					function(m_order[i]);
+				}
+			}
+			else
+			{
+				stack[size++] = node.first + 1;
+				stack[size++] = node.first;
+			}
+		}
+	}
+
+	// Expected tests of a query over the whole root box, boxes and triangles alike; refits make it grow
+	float getCost() const;
+	// Cost right after the last build
+	float getBuildCost() const { return m_buildCost; }
+
+	size_t getTrianglesCount() const { return m_indices.size() / 3; }
+	const std::vector<Node>& getNodes() const { return m_nodes; }
+	const std::vector<glm::vec3>& getPositions() const { return m_positions; }
+	const std::vector<uint32_t>& getIndices() const { return m_indices; }
+
+	static glm::vec3 closestPointOnTriangle(const glm::vec3& point, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+private:
+	struct Bounds
+	{
+		glm::vec3 minimum = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 maximum = glm::vec3(-std::numeric_limits<float>::max());
+
+		void grow(const glm::vec3& point) { minimum = glm::min(minimum, point); maximum = glm::max(maximum, point); }
+		void grow(const Bounds& bounds) { minimum = glm::min(minimum, bounds.minimum); maximum = glm::max(maximum, bounds.maximum); }
+		float area() const;
+	};
+
+	struct Bin
+	{
+		Bounds bounds;
+		uint32_t count = 0;
+	};
+
+	static const uint32_t binsCount = 12;
+	static const uint32_t leafSize = 4;
+
+	void subdivide(uint32_t nodeIndex, uint32_t depth);
+	void updateBounds(Node& node) const;
+	Bounds getTriangleBounds(uint32_t triangle) const;
+
+	std::vector<glm::vec3> m_positions;
+	std::vector<uint32_t> m_indices;
+	std::vector<glm::vec3> m_centroids;
+	std::vector<uint32_t> m_order;// triangles sorted so every leaf owns a contiguous range
+	std::vector<Node> m_nodes;
+	float m_buildCost = 0.0f;
+};
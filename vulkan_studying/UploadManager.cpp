@@ -0,0 +1,517 @@
+#include "UploadManager.h"
+#include <map>
+
+
+namespace
+{
+	// Keeps every staging copy source at an offset friendly to any copy engine
+	const VkDeviceSize stagingAlignment = 16;
+
+	// Byte ranges of buffers, kept merged and sorted per buffer
+	class BufferRanges
+	{
+	public:
+		bool overlaps(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) const
+		{
+			auto bufferRanges = m_ranges.find(buffer);
+			if (bufferRanges == m_ranges.end())
+			{
+				return false;
+			}
+			// Ranges are disjoint, so only the last one starting before the end can reach into this one
+			auto range = bufferRanges->second.lower_bound(offset + size);
+			return range != bufferRanges->second.begin() && std::prev(range)->second > offset;
+		}
+
+		void insert(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size)
+		{
+			std::map<VkDeviceSize, VkDeviceSize>& ranges = m_ranges[buffer];
+			VkDeviceSize begin = offset;
+			VkDeviceSize end = offset + size;
+			auto range = ranges.upper_bound(end);
+			while (range != ranges.begin() && std::prev(range)->second >= begin)
+			{
+				--range;
+				begin = std::min(begin, range->first);
+				end = std::max(end, range->second);
+				range = ranges.erase(range);
+			}
+			ranges[begin] = end;
+		}
+
+		void clear()
+		{
+			m_ranges.clear();
+		}
+
+	private:
+		std::map<VkBuffer, std::map<VkDeviceSize, VkDeviceSize>> m_ranges;// begin to end
+	};
+}
+
+UploadManager::~UploadManager()
+{
+	destroy();
+}
+
+void UploadManager::init(VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize stagingSize)
+{
+	m_queue = queue;
+	m_queueFamilyIndex = queueFamilyIndex;
+	m_commandPool = m_device.createCommandPool(queueFamilyIndex, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	if (stagingSize == 0)
+	{
+		return;
+	}
+
+	m_device.createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_stagingBuffer, m_stagingAllocation);
+	GpuAllocation allocation = m_stagingAllocation;
+	m_staging = static_cast<uint8_t*>(allocation->mapped);
+	m_stagingSize = stagingSize;
+}
+
+void UploadManager::addConsumer(VkQueue queue, uint32_t queueFamilyIndex)
+{
+	if (queueFamilyIndex == m_queueFamilyIndex)
+	{
+		return;
+	}
+	if (!m_batches.empty())
+	{
+		throw std::runtime_error("upload consumers must be added before the first flush");
+	}
+
+	Consumer consumer;
+	consumer.queue = queue;
+	consumer.queueFamilyIndex = queueFamilyIndex;
+	consumer.commandPool = m_device.createCommandPool(queueFamilyIndex, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	m_consumers.push_back(consumer);
+}
+
+void UploadManager::destroy()
+{
+	if (m_commandPool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	while (!m_inFlight.empty())
+	{
+		retire(true);
+	}
+	for (auto& batch : m_batches)
+	{
+		vkDestroyFence(m_device.getLogicalDevice(), batch.fence, nullptr);
+		for (auto& acquire : batch.acquires)
+		{
+			vkDestroySemaphore(m_device.getLogicalDevice(), acquire.semaphore, nullptr);
+			vkDestroyFence(m_device.getLogicalDevice(), acquire.fence, nullptr);
+		}
+	}
+	m_batches.clear();
+	for (auto& consumer : m_consumers)
+	{
+		vkDestroyCommandPool(m_device.getLogicalDevice(), consumer.commandPool, nullptr);
+	}
+	m_consumers.clear();
+	vkDestroyCommandPool(m_device.getLogicalDevice(), m_commandPool, nullptr);
+	m_commandPool = VK_NULL_HANDLE;
+
+	m_stagingBuffer.reset();
+	m_stagingAllocation.reset();
+	m_staging = nullptr;
+}
+
+UploadTicket UploadManager::upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, uint32_t dstQueueFamilyIndex)
+{
+	uint32_t consumer = getConsumer(dstQueueFamilyIndex);
+	if (m_staging == nullptr)
+	{
+		throw std::runtime_error("upload manager has no staging memory");
+	}
+
+	const uint8_t* source = static_cast<const uint8_t*>(data);
+	while (size > 0)
+	{
+		VkDeviceSize part = std::min(size, m_stagingSize);
+		VkDeviceSize offset = reserve(part);
+		memcpy(m_staging + offset, source, static_cast<size_t>(part));
+
+		PendingCopy pending;
+		pending.srcBuffer = m_stagingBuffer;
+		pending.dstBuffer = dstBuffer;
+		pending.region.srcOffset = offset;
+		pending.region.dstOffset = dstOffset;
+		pending.region.size = part;
+		pending.consumer = consumer;
+		m_pending.push_back(pending);
+
+		source += part;
+		dstOffset += part;
+		size -= part;
+	}
+	return m_nextTicket;
+}
+
+UploadTicket UploadManager::copy(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset,
+	uint32_t dstQueueFamilyIndex)
+{
+	uint32_t consumer = getConsumer(dstQueueFamilyIndex);
+	PendingCopy pending;
+	pending.srcBuffer = srcBuffer;
+	pending.dstBuffer = dstBuffer;
+	pending.region.srcOffset = srcOffset;
+	pending.region.dstOffset = dstOffset;
+	pending.region.size = size;
+	pending.consumer = consumer;
+	m_pending.push_back(pending);
+	return m_nextTicket;
+}
+
+UploadTicket UploadManager::flush()
+{
+	retire(false);
+	if (m_pending.empty())
+	{
+		return m_nextTicket - 1;
+	}
+
+	Batch& batch = getFreeBatch();
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (vkBeginCommandBuffer(batch.commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to begin upload command buffer");
+	}
+
+	// Earlier work on the queue may still read what gets overwritten here, or have written what copies read
+	VkMemoryBarrier leadingBarrier = {};
+	leadingBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	leadingBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+	leadingBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &leadingBarrier, 0, nullptr, 0, nullptr);
+
+	// Copies run in the order they were made. Neighbouring ones between the same pair of buffers go out as one
+	// command, unless a copy touches bytes an earlier one since the last barrier read or wrote: such a copy
+	// starts a new command after a barrier, which also keeps the regions of a command from overlapping
+	VkMemoryBarrier hazardBarrier = {};
+	hazardBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	hazardBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	hazardBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	BufferRanges reads;
+	BufferRanges writes;
+	std::vector<VkBufferCopy> regions;
+	for (size_t first = 0; first < m_pending.size();)
+	{
+		size_t last = first;
+		regions.clear();
+		while (last < m_pending.size() && m_pending[last].srcBuffer == m_pending[first].srcBuffer && m_pending[last].dstBuffer == m_pending[first].dstBuffer)
+		{
+			const PendingCopy& pending = m_pending[last];
+			const VkBufferCopy& region = pending.region;
+			if (writes.overlaps(pending.srcBuffer, region.srcOffset, region.size) ||
+				writes.overlaps(pending.dstBuffer, region.dstOffset, region.size) ||
+				reads.overlaps(pending.dstBuffer, region.dstOffset, region.size))
+			{
+				if (!regions.empty())
+				{
+					break;
+				}
+				vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &hazardBarrier, 0, nullptr, 0, nullptr);
+				reads.clear();
+				writes.clear();
+			}
+
+			reads.insert(pending.srcBuffer, region.srcOffset, region.size);
+			writes.insert(pending.dstBuffer, region.dstOffset, region.size);
+			regions.push_back(region);
+			last++;
+		}
+		vkCmdCopyBuffer(batch.commandBuffer, m_pending[first].srcBuffer, m_pending[first].dstBuffer, static_cast<uint32_t>(regions.size()), regions.data());
+		first = last;
+	}
+
+	// Destinations used by another family are released to it, the same barriers acquire them on its queue
+	std::vector<std::vector<VkBufferMemoryBarrier>> ownership(m_consumers.size());
+	std::vector<VkBufferMemoryBarrier> releases;
+	for (const auto& pending : m_pending)
+	{
+		if (pending.consumer == noConsumer)
+		{
+			continue;
+		}
+
+		VkBufferMemoryBarrier release = {};
+		release.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		release.srcQueueFamilyIndex = m_queueFamilyIndex;
+		release.dstQueueFamilyIndex = m_consumers[pending.consumer].queueFamilyIndex;
+		release.buffer = pending.dstBuffer;
+		release.offset = pending.region.dstOffset;
+		release.size = pending.region.size;
+		releases.push_back(release);
+		ownership[pending.consumer].push_back(release);
+	}
+	m_pending.clear();
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+	vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier,
+		static_cast<uint32_t>(releases.size()), releases.data(), 0, nullptr);
+
+	if (vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to end upload command buffer");
+	}
+
+	std::vector<VkSemaphore> signalSemaphores;
+	for (size_t i = 0; i < m_consumers.size(); i++)
+	{
+		batch.acquires[i].used = !ownership[i].empty();
+		if (batch.acquires[i].used)
+		{
+			signalSemaphores.push_back(batch.acquires[i].semaphore);
+		}
+	}
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer;
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+	submitInfo.pSignalSemaphores = signalSemaphores.data();
+	if (vkQueueSubmit(m_queue, 1, &submitInfo, batch.fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit uploads");
+	}
+	m_submitsCount++;
+
+	for (size_t i = 0; i < m_consumers.size(); i++)
+	{
+		if (batch.acquires[i].used)
+		{
+			submitAcquire(batch.acquires[i], m_consumers[i], ownership[i]);
+		}
+	}
+
+	batch.ticket = m_nextTicket++;
+	batch.stagingEnd = m_stagingWritten;
+	batch.inFlight = true;
+	m_inFlight.push_back(&batch - m_batches.data());
+	return batch.ticket;
+}
+
+bool UploadManager::isComplete(UploadTicket ticket)
+{
+	retire(false);
+	return ticket <= m_completedTicket;
+}
+
+void UploadManager::wait(UploadTicket ticket)
+{
+	if (ticket >= m_nextTicket)
+	{
+		flush();
+	}
+	while (ticket > m_completedTicket && !m_inFlight.empty())
+	{
+		retire(true);
+	}
+}
+
+VkDeviceSize UploadManager::reserve(VkDeviceSize size)
+{
+	for (;;)
+	{
+		uint64_t position = (m_stagingWritten + stagingAlignment - 1) / stagingAlignment * stagingAlignment;
+		VkDeviceSize offset = position % m_stagingSize;
+		// An allocation never wraps, the ring tail is skipped instead
+		if (offset + size > m_stagingSize)
+		{
+			position += m_stagingSize - offset;
+			offset = 0;
+		}
+
+		if (position + size - m_stagingReleased <= m_stagingSize)
+		{
+			m_stagingWritten = position + size;
+			return offset;
+		}
+
+		// Nothing left in use, start over at the beginning of the ring
+		if (m_stagingReleased == m_stagingWritten)
+		{
+			m_stagingWritten = (m_stagingWritten + m_stagingSize - 1) / m_stagingSize * m_stagingSize;
+			m_stagingReleased = m_stagingWritten;
+			continue;
+		}
+
+		// Full: the pending copies have to go out before their staging space can ever come back
+		if (m_inFlight.empty())
+		{
+			flush();
+		}
+		retire(true);
+	}
+}
+
+uint32_t UploadManager::getConsumer(uint32_t queueFamilyIndex) const
+{
+	if (queueFamilyIndex == VK_QUEUE_FAMILY_IGNORED || queueFamilyIndex == m_queueFamilyIndex)
+	{
+		return noConsumer;
+	}
+	for (uint32_t i = 0; i < m_consumers.size(); i++)
+	{
+		if (m_consumers[i].queueFamilyIndex == queueFamilyIndex)
+		{
+			return i;
+		}
+	}
+	throw std::runtime_error("no queue registered to acquire uploads for this family");
+}
+
+void UploadManager::submitAcquire(Acquire& acquire, const Consumer& consumer, std::vector<VkBufferMemoryBarrier>& barriers)
+{
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (vkBeginCommandBuffer(acquire.commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to begin upload acquire command buffer");
+	}
+
+	// The semaphore wait already covers the copies, the barrier only hands the ranges over and makes them visible
+	for (auto& barrier : barriers)
+	{
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+	}
+	vkCmdPipelineBarrier(acquire.commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+
+	if (vkEndCommandBuffer(acquire.commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to end upload acquire command buffer");
+	}
+
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &acquire.semaphore;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &acquire.commandBuffer;
+	if (vkQueueSubmit(consumer.queue, 1, &submitInfo, acquire.fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit upload acquire");
+	}
+	m_submitsCount++;
+}
+
+void UploadManager::retire(bool waitOldest)
+{
+	std::vector<VkFence> fences;
+	while (!m_inFlight.empty())
+	{
+		// A batch is done once its copies and every acquire it caused have executed
+		Batch& batch = m_batches[m_inFlight.front()];
+		fences.assign(1, batch.fence);
+		for (const auto& acquire : batch.acquires)
+		{
+			if (acquire.used)
+			{
+				fences.push_back(acquire.fence);
+			}
+		}
+
+		VkResult status = VK_SUCCESS;
+		if (waitOldest)
+		{
+			status = vkWaitForFences(m_device.getLogicalDevice(), static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+		}
+		else
+		{
+			for (size_t i = 0; i < fences.size() && status == VK_SUCCESS; i++)
+			{
+				status = vkGetFenceStatus(m_device.getLogicalDevice(), fences[i]);
+			}
+		}
+		if (status != VK_SUCCESS)
+		{
+			if (status == VK_NOT_READY || status == VK_TIMEOUT)
+			{
+				return;
+			}
+			throw std::runtime_error("failed to wait for uploads");
+		}
+
+		vkResetFences(m_device.getLogicalDevice(), static_cast<uint32_t>(fences.size()), fences.data());
+		for (auto& acquire : batch.acquires)
+		{
+			acquire.used = false;
+		}
+		batch.inFlight = false;
+		m_completedTicket = batch.ticket;
+		m_stagingReleased = batch.stagingEnd;
+		m_inFlight.erase(m_inFlight.begin());
+		waitOldest = false;
+	}
+}
+
+UploadManager::Batch& UploadManager::getFreeBatch()
+{
+	for (auto& batch : m_batches)
+	{
+		if (!batch.inFlight)
+		{
+			return batch;
+		}
+	}
+
+	Batch batch = {};
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandPool = m_commandPool;
+	allocateInfo.commandBufferCount = 1;
+	if (vkAllocateCommandBuffers(m_device.getLogicalDevice(), &allocateInfo, &batch.commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate upload command buffer");
+	}
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	if (vkCreateFence(m_device.getLogicalDevice(), &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create upload fence");
+	}
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	for (const auto& consumer : m_consumers)
+	{
+		Acquire acquire = {};
+		allocateInfo.commandPool = consumer.commandPool;
+		if (vkAllocateCommandBuffers(m_device.getLogicalDevice(), &allocateInfo, &acquire.commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate upload acquire command buffer");
+		}
+		if (vkCreateSemaphore(m_device.getLogicalDevice(), &semaphoreInfo, nullptr, &acquire.semaphore) != VK_SUCCESS ||
+			vkCreateFence(m_device.getLogicalDevice(), &fenceInfo, nullptr, &acquire.fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload acquire synchronization objects");
+		}
+		batch.acquires.push_back(acquire);
+	}
+
+	m_batches.push_back(batch);
+	return m_batches.back();
+}
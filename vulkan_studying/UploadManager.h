@@ -0,0 +1,116 @@
+#pragma once
+#include "Device.h"
+
+// Identifies the batch an upload went out with; batches complete in submission order
+typedef uint64_t UploadTicket;
+
+// Streams data into device buffers through one persistently mapped staging ring. Uploads are only recorded
+// until flush(), which puts every pending copy into a single command buffer and submits it with a fence;
+// the queue is never idled, callers wait on tickets only when they really need the data on the GPU.
+// Copies are fenced by barriers on both sides, so work submitted to the same queue before a batch may still
+// read the destinations and work submitted after it sees the new contents. Within a batch, copies take effect
+// in the order they were made, even when they touch the same bytes.
+// On a dedicated transfer queue, uploads meant for another family are released by the batch and acquired by a
+// small submission the manager makes on that family's queue, after a semaphore; work submitted there after
+// flush() owns and sees the data. Nothing orders such an upload after earlier reads on the other queue, so
+// cross-family uploads are for buffers that queue is not using yet, such as fresh assets or streamed ranges
+class UploadManager
+{
+public:
+	explicit UploadManager(Device& device) : m_device(device) {}
+	~UploadManager();
+
+	UploadManager(const UploadManager&) = delete;
+	UploadManager& operator=(const UploadManager&) = delete;
+
+	// Call once the device exists; copies are submitted to queue, which must belong to queueFamilyIndex.
+	// A stagingSize of 0 makes a copy-only manager, upload() is unavailable then
+	void init(VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize stagingSize = VkDeviceSize(16) << 20);
+	// Registers the queue that acquires uploads for queueFamilyIndex; a family equal to the upload queue's needs none
+	void addConsumer(VkQueue queue, uint32_t queueFamilyIndex);
+	// Waits for the batches in flight and releases everything, the device must still be alive
+	void destroy();
+
+	// Copies data into the staging ring now, the GPU copy goes out with the next flush(); larger uploads than the ring are split.
+	// dstQueueFamilyIndex is the family that uses the buffer afterwards, VK_QUEUE_FAMILY_IGNORED for the upload queue's own
+	UploadTicket upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED);
+	// Buffer to buffer copy batched with the uploads, srcBuffer has to be readable by the upload queue's family
+	UploadTicket copy(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0,
+		uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED);
+
+	// Submits every pending copy as one batch; returns the ticket of the last submitted batch
+	UploadTicket flush();
+
+	bool isComplete(UploadTicket ticket);
+	// Blocks on the fence of the ticket's batch, flushing it first if it is still pending
+	void wait(UploadTicket ticket);
+
+	VkDeviceSize getStagingSize() const { return m_stagingSize; }
+	// Queue submissions made so far, acquires on consumer queues included
+	uint64_t getSubmitsCount() const { return m_submitsCount; }
+
+private:
+	static const uint32_t noConsumer = ~0u;
+
+	struct PendingCopy
+	{
+		VkBuffer srcBuffer;
+		VkBuffer dstBuffer;
+		VkBufferCopy region;
+		uint32_t consumer;// index into m_consumers, or noConsumer
+	};
+
+	struct Consumer
+	{
+		VkQueue queue;
+		uint32_t queueFamilyIndex;
+		VkCommandPool commandPool;
+	};
+
+	// Acquire side of one batch on one consumer queue
+	struct Acquire
+	{
+		VkCommandBuffer commandBuffer;
+		VkSemaphore semaphore;
+		VkFence fence;
+		bool used;
+	};
+
+	struct Batch
+	{
+		VkCommandBuffer commandBuffer;
+		VkFence fence;
+		std::vector<Acquire> acquires;// one per consumer
+		UploadTicket ticket;
+		uint64_t stagingEnd;// staging bytes written up to this batch, released when it completes
+		bool inFlight;
+	};
+
+	// Returns the ring offset of size free bytes, retiring or waiting for old batches when the ring is full
+	VkDeviceSize reserve(VkDeviceSize size);
+	uint32_t getConsumer(uint32_t queueFamilyIndex) const;
+	void submitAcquire(Acquire& acquire, const Consumer& consumer, std::vector<VkBufferMemoryBarrier>& barriers);
+	void retire(bool waitOldest);
+	Batch& getFreeBatch();
+
+	Device& m_device;
+	VkQueue m_queue = VK_NULL_HANDLE;
+	uint32_t m_queueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	VkCommandPool m_commandPool = VK_NULL_HANDLE;
+	std::vector<Consumer> m_consumers;
+
+	DeviceCleaner<VkBuffer, vkDestroyBuffer> m_stagingBuffer;
+	RootCleaner<GpuAllocation, freeGpuAllocation> m_stagingAllocation;
+	uint8_t* m_staging = nullptr;
+	VkDeviceSize m_stagingSize = 0;
+	uint64_t m_stagingWritten = 0;
+	uint64_t m_stagingReleased = 0;
+
+	std::vector<PendingCopy> m_pending;
+	std::vector<Batch> m_batches;
+	std::vector<size_t> m_inFlight;// indices into m_batches, oldest first
+
+	UploadTicket m_nextTicket = 1;
+	UploadTicket m_completedTicket = 0;
+	uint64_t m_submitsCount = 0;
+};
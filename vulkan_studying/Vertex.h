@@ -2,6 +2,7 @@
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
+#include "GpuLayout.h"
 #include <array>
 
 struct Vertex
@@ -43,4 +44,11 @@ struct UniformBufferObject
 	glm::mat4 model;
 	glm::mat4 view;
 	glm::mat4 projection;
-};
\ No newline at end of file
+};
+
+// Matches the std140 uniform block in shader.vert
+typedef GpuStructLayout<GpuLayoutRule::Std140, glm::mat4, glm::mat4, glm::mat4> UniformBufferObjectLayout;
+GPU_LAYOUT_CHECK_MEMBER(UniformBufferObject, UniformBufferObjectLayout, 0, model);
+GPU_LAYOUT_CHECK_MEMBER(UniformBufferObject, UniformBufferObjectLayout, 1, view);
+GPU_LAYOUT_CHECK_MEMBER(UniformBufferObject, UniformBufferObjectLayout, 2, projection);
+GPU_LAYOUT_CHECK_SIZE(UniformBufferObject, UniformBufferObjectLayout);
\ No newline at end of file
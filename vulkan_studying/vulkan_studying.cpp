@@ -4,6 +4,7 @@
 #include "stdio.h"
 
 #include "BaseApplication.h"
+#include "FluidSweep.h"
 
 #include <iostream>
 #include <cassert>
@@ -11,13 +12,141 @@
 #include <functional>
 
 
+// Water-like defaults shared by the command line runs
+static FluidParams getDefaultParams(uint32_t particlesCount)
+{
+	FluidParams params = {};
+	params.particlesCount = particlesCount;
+	params.particleRadius = 0.0136f;
+	params.particleMass = 0.02f;
+	params.particleRestingDensity = 998.29f;
+	params.particleStiffness = 3.0f;
+	params.particleViscosity = 3.5f;
+	params.smoothingLength = 0.0457f;
+	params.force = glm::vec3(0.0f, -9.8f, 0.0f);
+	params.timeStep = 0.002f;
+	return params;
+}
+
+// vulkan_studying --sweep <variants.csv> <results.csv> [steps] [particles]
+// Runs every variant headless on all cores, no window or Vulkan device is created
+static int runSweep(int argc, char** argv)
+{
+	if (argc < 4)
+	{
+		std::cerr << "usage: " << argv[0] << " --sweep <variants.csv> <results.csv> [steps] [particles]" << std::endl;
+		return 1;
+	}
+
+	FluidParticle particle = {};
+	FluidParams base = getDefaultParams(argc > 5 ? static_cast<uint32_t>(std::stoul(argv[5])) : 4096);
+
+	FluidSweep sweep(particle, argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4])) : 200);
+	sweep.loadVariants(argv[2], base);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<FluidSweepResult> results = sweep.run();
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	FluidSweep::writeCsv(argv[3], results);
+	std::cout << results.size() << " runs in " << seconds << " s" << std::endl;
+	return 0;
+}
+
+// vulkan_studying --headless <stats.csv> [steps] [particles] [recording]
+// Simulates one fluid on a compute-only device, without SDL, surface or swapchain
+static int runHeadless(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		std::cerr << "usage: " << argv[0] << " --headless <stats.csv> [steps] [particles] [recording]" << std::endl;
+		return 1;
+	}
+
+	HeadlessSettings settings = {};
+	settings.particle = {};
+	settings.params = getDefaultParams(argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4])) : 4096);
+	settings.stepsCount = argc > 3 ? static_cast<uint32_t>(std::stoul(argv[3])) : 200;
+	settings.statsFilename = argv[2];
+	if (argc > 5)
+	{
+		settings.recordingFilename = argv[5];
+	}
+
+	BaseApplication app;
+	app.runHeadless(settings);
+	return 0;
+}
+
+// vulkan_studying --publish <ring name> <stats.csv> [steps] [particles]
+// Simulates headless like --headless and publishes every frame for --view processes; 0 steps runs until stopped
+static int runPublisher(int argc, char** argv)
+{
+	if (argc < 4)
+	{
+		std::cerr << "usage: " << argv[0] << " --publish <ring name> <stats.csv> [steps] [particles]" << std::endl;
+		return 1;
+	}
+
+	HeadlessSettings settings = {};
+	settings.particle = {};
+	settings.params = getDefaultParams(argc > 5 ? static_cast<uint32_t>(std::stoul(argv[5])) : 4096);
+	settings.stepsCount = argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4])) : 0;
+	settings.statsFilename = argv[3];
+	settings.frameRingName = argv[2];
+
+	BaseApplication app;
+	app.runHeadless(settings);
+	return 0;
+}
 
 int main(int argc, char** argv)
 {
+	if (argc > 1 && std::string(argv[1]) == "--publish")
+	{
+		try {
+			return runPublisher(argc, argv);
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--headless")
+	{
+		try {
+			return runHeadless(argc, argv);
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--sweep")
+	{
+		try {
+			return runSweep(argc, argv);
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+	}
+
 	BaseApplication app;
 
 	try {
-		app.run();
+		// vulkan_studying --view <ring name> draws the fluid a --publish process simulates
+		if (argc > 2 && std::string(argv[1]) == "--view")
+		{
+			app.runViewer(argv[2]);
+		}
+		else
+		{
+			app.run();
+		}
 	}
 	catch (const std::runtime_error& e) {
 		std::cerr << e.what() << std::endl;
@@ -26,4 +155,3 @@ int main(int argc, char** argv)
 
 	return 0;
 }
-